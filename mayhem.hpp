@@ -23,16 +23,42 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 // Headers
 
 #include <bits/stdc++.h>
-#include "nnue.hpp"
-#include "polyglotbook.hpp"
-#include "eucalyptus.hpp"
 
 extern "C" {
   #ifdef WINDOWS
     #include <conio.h>
+  #else
+    #include <sys/mman.h>
+  #endif
+  #if defined(__x86_64__)
+    #include <cpuid.h>
   #endif
 }
 
+// Default NNUE evaluation file ( The Makefile passes its EVALFILE )
+#ifndef MAYHEMEVALFILE
+  #define MAYHEMEVALFILE "nn-cb80fb9393af.nnue"
+#endif
+
+// Default NNUE and book inside the executable ( make EMBED=yes ). The book is read in place.
+// The net too if it's in the mapped format, the default one is permuted into a private copy
+#ifdef MAYHEMEMBED
+  #define NNUE_EMBEDDED
+  #define MAYHEM_INCBIN(name, file) \
+    __asm__(".section .rodata\n.balign 64\n.global g" #name "Data\ng" #name "Data:\n" \
+            ".incbin \"" file "\"\n.global g" #name "End\ng" #name "End:\n.previous\n"); \
+    extern "C" const std::uint8_t g ## name ## Data[], g ## name ## End[]
+  MAYHEM_INCBIN(Network, MAYHEMEVALFILE);
+  MAYHEM_INCBIN(Book, "final-book.bin");
+  const char *const DefaultEvalFile = MAYHEMEVALFILE;
+  const std::size_t gNetworkSize    = static_cast<std::size_t>(gNetworkEnd - gNetworkData);
+  const std::size_t gBookSize       = static_cast<std::size_t>(gBookEnd - gBookData);
+#endif
+
+#include "nnue.hpp"
+#include "polyglotbook.hpp"
+#include "eucalyptus.hpp"
+
 // Namespace
 
 namespace mayhem {
@@ -41,13 +67,18 @@ namespace mayhem {
 
 const std::string VERSION          = "Mayhem 8.8"; // Version
 const std::string STARTPOS         = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"; // UCI startpos
-const std::string EVAL_FILE        = "nn-cb80fb9393af.nnue"; // Default NNUE evaluation file
+const std::string EVAL_FILE        = MAYHEMEVALFILE;        // Default NNUE evaluation file
+const std::string EVAL_FILE_SMALL  = "<empty>";              // Optional small NNUE for short searches and endgames
 const std::string BOOK_FILE        = "final-book.bin";       // Default Polyglot book file
 constexpr int MAX_MOVES            = 256;      // Max chess moves
 constexpr int MAX_SEARCH_DEPTH     = 64;       // Max search depth (Stack frame problems ...)
 constexpr int MAX_Q_SEARCH_DEPTH   = 16;       // Max Qsearch depth
+constexpr int MAX_THREADS          = 512;      // Max search threads
 constexpr int INF                  = 1048576;  // System max number
+constexpr int NO_EVAL              = -32768;   // No static eval in the hashtable
 constexpr int DEF_HASH_MB          = 256;      // MiB
+constexpr int DEF_EVAL_HASH_MB     = 16;       // MiB ( Eval cache )
+constexpr std::size_t HUGE_PAGE    = (2 << 20); // 2 MiB pages for the hashtable
 constexpr int NOISE                = 2;        // Noise for opening moves
 constexpr int MOVEOVERHEAD         = 100;      // ms
 constexpr int REPS_DRAW            = 3;        // 3rd repetition is a draw
@@ -55,6 +86,7 @@ constexpr int FIFTY                = 100;      // 100 moves w/o progress is a dr
 constexpr int R50_ARR              = (FIFTY + 2); // Checkmate overrules 50 move rep so extra space here
 constexpr int SHUFFLE              = 30;       // Allow shuffling then scale
 constexpr int BOOK_MS              = 100;      // At least 100ms+ for the book lookup
+constexpr int SMALL_NET_MS         = 1000;     // Searches shorter than this use the small NNUE
 constexpr int LEVEL                = 100;      // Level of engine. ( 0: Random, 1-99: Levels, 100: Full)
 constexpr int NOISE_PAWNS          = 5;        // Add noise to eval for different playing levels ( -5 -> +5 pawns )
 constexpr int PERFT_DEPTH          = 6;        // Perft at depth 6
@@ -66,6 +98,23 @@ constexpr int FRC_PENALTY          = 100; // Penalty for bishop blocked on corne
 constexpr int TEMPO_BONUS          = 25;  // Bonus for the side to move
 constexpr int BISHOP_PAIR_BONUS    = 20;  // Both colored bishops bonus
 constexpr int CHECKS_BONUS         = 17;  // Bonus for checks
+constexpr int HISTORY_MAX          = 16384; // History tables saturate here ( Gravity )
+constexpr int HISTORY_BONUS        = 1200;  // Max history bonus / malus per cutoff
+constexpr int COUNTERMOVE_BONUS    = 8192;  // Countermove on top of its history score
+constexpr int DELTA_MARGIN         = 200;   // Qsearch: Skip captures that can't reach alpha even w/ this bonus
+constexpr int Q_CHECK_PLIES        = 2;     // Qsearch: Answer checks w/ all evasions only in the first plies
+constexpr int ASPIRATION_DEPTH     = 4;     // Aspiration windows from this iteration on
+constexpr int ASPIRATION_WINDOW    = 25;    // Initial half window around the last score
+constexpr int ASPIRATION_MAX       = 1000;  // Wider than this / Bigger scores -> Full window
+constexpr int RFP_DEPTH            = 6;     // Reverse futility: Eval - margin * depth >= beta -> Cut
+constexpr int RFP_MARGIN           = 80;
+constexpr int RAZOR_DEPTH          = 2;     // Razoring: Eval + margin * depth <= alpha -> Qsearch decides
+constexpr int RAZOR_MARGIN         = 250;
+constexpr int FUTILITY_DEPTH       = 3;     // Futility: Eval + margin * depth <= alpha -> Skip quiets
+constexpr int FUTILITY_MARGIN      = 120;
+constexpr int LMP_DEPTH            = 4;     // Late move pruning: Skip quiets after base + depth^2 moves
+constexpr int LMP_BASE             = 3;
+constexpr int IIR_DEPTH            = 4;     // No hash move at this depth or deeper -> Reduce by 1 ply
 constexpr bool BOOK_BEST           = false;    // Nondeterministic opening play
 constexpr std::uint64_t READ_CLOCK = 0x1FFULL; // Read clock every 512 ticks (white / 2 x both)
 
@@ -131,6 +180,9 @@ constexpr int kMvv[6][6] = {
 // Evaluation phases      ( P  N  B  R  Q  K )
 constexpr int kPiece[6] = { 1, 3, 3, 5, 9, 0 }; // Must match MAX_PIECES !
 
+// Static exchange values ( P  N  B  R  Q  K )
+constexpr int kSee[6] = { 100, 300, 300, 500, 900, 10000 };
+
 // ( MG  EG ) -> ( P  N  B  R  Q  K )
 constexpr int kPestoMaterial[2][6] = {
   { 82, 337, 365, 477, 1025, 0 },
@@ -341,37 +393,91 @@ constexpr std::uint64_t kBishopMagics[3][64] = {
 
 // Enums
 
-enum class MoveType { kKiller, kGood };
+// Memory of the hashtable ( Off: 4 KiB pages / THP: madvise(MADV_HUGEPAGE) / HugeTLB: MAP_HUGETLB )
+enum class PageMode { kOff, kTHP, kHugeTLB };
+
+// Bound of the hashtable score ( Upper: score <= x / Lower: score >= x / Exact: score == x )
+enum class Bound : std::uint8_t { kNone, kUpper, kLower, kExact };
+
+// Stages of the move picker ( Next stage is generated only if no cutoff )
+enum class Stage : std::uint8_t {
+  kHash, kGenCaptures, kGoodCaptures, kKillers, kGenQuiets, kQuiets, kBadCaptures, kEvasions, kDone
+};
 
 // Structs
 
-struct Board { // 172B
+struct alignas(64) Board { // 192B ( 3 cache lines -> Aligned copy-on-make )
   std::uint64_t white[6]{};   // White bitboards
   std::uint64_t black[6]{};   // Black bitboards
-  std::int32_t  score{0};     // Sorting score
+  std::uint64_t hash{0};      // Zobrist hash ( Updated incrementally )
   std::int8_t   pieces[64]{}; // Pieces white and black
   std::int8_t   epsq{-1};     // En passant square
-  std::uint8_t  index{0};     // Sorting index
   std::uint8_t  from{0};      // From square
   std::uint8_t  to{0};        // To square
-  std::uint8_t  type{0};      // Move type ( 0:Normal 1:OOw 2:OOOw 3:OOb 4:OOOb 5:=n 6:=b 7:=r 8:=q )
+  std::uint8_t  type{0};      // Move type ( 0:Normal 1:OOw 2:OOOw 3:OOb 4:OOOb 5:=n 6:=b 7:=r 8:=q 9:Null )
   std::uint8_t  castle{0};    // Castling rights ( 0x1:K 0x2:Q 0x4:k 0x8:q )
   std::uint8_t  fifty{0};     // Rule 50 counter ( 256 max )
   bool is_underpromo() const;
   bool is_queen_promo() const;
   bool is_castling() const;
+  bool is_nullmove() const;
+  std::uint16_t move16() const;
   const std::string movename() const;
   const std::string to_fen() const;
   const std::string to_s() const;
 };
 
-struct HashEntry { // 10B
-  std::uint32_t killer_hash{0}; // Killer move hash
-  std::uint32_t good_hash{0};   // Good move hash
-  std::uint8_t  killer{0};      // Killer move index
-  std::uint8_t  good{0};        // Good move index
-  template <MoveType> void update(const std::uint64_t, const std::uint8_t);
-  void put_hash_value_to_moves(const std::uint64_t, Board*) const;
+struct HashEntry { // 16B
+  std::uint32_t key{0};      // Lower 32 bits of the hash ( Upper bits pick the bucket )
+  std::int32_t  score{0};    // Search score ( White POV )
+  std::int16_t  eval{NO_EVAL}; // Static eval ( White POV )
+  std::uint16_t move{0};     // Best move ( See: Board::move16 )
+  std::uint8_t  depth{0};    // Search depth
+  std::uint8_t  genbound{0}; // Generation (6b) + Bound (2b)
+  Bound bound() const;
+  int age() const;
+  int worth() const;
+  bool is_ok(const std::uint64_t) const;
+  bool cutoff(const std::uint64_t, const int, const int, const int) const;
+  int static_eval(const std::uint64_t) const;
+  std::uint16_t best_move(const std::uint64_t) const;
+};
+
+struct alignas(64) HashBucket { // 64B ( 1 cache line )
+  HashEntry entries[4]{};
+  HashEntry find(const std::uint64_t) const;
+  void store(const std::uint64_t, const int, const int, const int, const Bound, const std::uint16_t);
+};
+
+// Search state of one ply
+struct SearchStack {
+  int           eval{NO_EVAL};     // Static eval ( White POV / NO_EVAL in checks )
+  int           raw_eval{NO_EVAL}; // Before noise and scale ( Goes to the hashtable )
+  std::uint16_t move{0};           // Move made from this ply
+  std::uint16_t killers[2]{};      // Quiet cutoff moves
+  bool          improving{false};  // Static eval better than 2 plies ago ?
+};
+
+// Staged move generation: Hash move -> Good captures -> Killers -> Quiets -> Bad captures
+// Under checks all evasions are generated at once
+struct MovePicker {
+  Board *const parent{nullptr};
+  const int ply{0};
+  const bool wtm{true};
+  const std::uint16_t hash_move{0}, killers[2]{}, counter_move{0};
+  Stage stage{Stage::kHash};
+  int n{0}, i{0}, bad{0}, bad_n{0}, killer_i{0}, score{0};
+  bool sort{true};
+  bool is_quiet(const std::uint16_t) const;
+  bool is_good_capture(const std::uint16_t) const;
+  void mgen_setup() const;
+  void score_quiets(const int);
+  bool add_move(const std::uint16_t);
+  void remove_move(const int, const std::uint16_t);
+  void evasions();
+  std::uint16_t yield();
+  std::uint16_t pick(const int);
+  std::uint16_t next();
 };
 
 struct Evaluation {
@@ -429,7 +535,26 @@ struct NnueEval {
 };
 
 struct RootCompFunctor {
-  bool operator()(const Board &, const Board &) const;
+  bool operator()(const std::pair<int, std::uint16_t> &, const std::pair<int, std::uint16_t> &) const;
+};
+
+// Visited nodes of one thread ( Own cache line -> No false sharing )
+struct alignas(64) NodeCounter {
+  std::atomic<std::uint64_t> n{0}, eval_probes{0}, eval_hits{0};
+  void add();
+  void add_eval(const bool);
+};
+
+// Root position for the helper threads
+struct RootCopy {
+  const Board board{};
+  const std::vector<std::uint16_t> moves{};
+  const std::vector<std::int32_t> scores{};
+  const std::vector<std::uint64_t> r50_positions{};
+  const bool classical{true};
+  const int nnue_net{0};
+  RootCopy();
+  void setup() const;
 };
 
 // Material detection for classical activation
@@ -455,37 +580,74 @@ struct Save {
 
 // Variables
 
-std::uint64_t g_black = 0, g_white = 0, g_both = 0, g_empty = 0, g_good = 0, g_stop_search_time = 0,
-  g_nodes = 0, g_pawn_sq = 0, g_pawn_1_moves_w[64]{}, g_pawn_1_moves_b[64]{}, g_pawn_2_moves_w[64]{},
+std::uint64_t g_stop_search_time = 0, g_pawn_1_moves_w[64]{}, g_pawn_1_moves_b[64]{}, g_pawn_2_moves_w[64]{},
   g_pawn_2_moves_b[64]{}, g_knight_moves[64]{}, g_king_moves[64]{}, g_pawn_checks_w[64]{}, g_pawn_checks_b[64]{},
   g_castle_no_checks_w[2]{}, g_castle_no_checks_b[2]{}, g_castle_empty_w[2]{}, g_castle_empty_b[2]{}, g_bishop_magic_moves[64][512]{},
   g_rook_magic_moves[64][4096]{}, g_zobrist_ep[64]{}, g_zobrist_castle[16]{}, g_zobrist_wtm[2]{},
-  g_r50_positions[R50_ARR]{}, g_zobrist_board[13][64]{};
+  g_zobrist_board[13][64]{}, g_between[64][64]{}, g_line[64][64]{};
 
-int g_move_overhead = MOVEOVERHEAD, g_level = LEVEL, g_root_n = 0, g_king_w = 0, g_king_b = 0, g_moves_n = 0,
-  g_max_depth = MAX_SEARCH_DEPTH, g_q_depth = 0, g_depth = 0, g_best_score = 0, g_noise = NOISE, g_last_eval = 0,
-  g_fullmoves = 1, g_rook_w[2]{}, g_rook_b[2]{}, g_nnue_pieces[64]{}, g_nnue_squares[64]{};
+int g_move_overhead = MOVEOVERHEAD, g_level = LEVEL, g_king_w = 0, g_king_b = 0,
+  g_max_depth = MAX_SEARCH_DEPTH, g_noise = NOISE, g_last_eval = 0, g_threads = 1,
+  g_fullmoves = 1, g_rook_w[2]{}, g_rook_b[2]{};
 
-bool g_chess960 = false, g_wtm = false, g_underpromos = true, g_nullmove_active = false,
-  g_stop_search = false, g_is_pv = false, g_book_exist = false, g_nnue_exist = false,
-  g_classical = true, g_game_on = true, g_analyzing = false;
+bool g_chess960 = false, g_wtm = false, g_underpromos = true, g_book_exist = false, g_nnue_exist = false,
+  g_game_on = true, g_analyzing = false, g_pext = false;
 
-Board g_board_empty{}, *g_board = &g_board_empty, *g_moves = nullptr, *g_board_orig = nullptr,
-  g_boards[MAX_SEARCH_DEPTH + MAX_Q_SEARCH_DEPTH][MAX_MOVES]{};
+std::atomic<bool> g_stop_search = false; // Shared by all search threads
 
-std::uint32_t g_hash_entries = 0, g_tokens_nth = 0;
+std::uint64_t g_hash_buckets = 0;
+std::uint32_t g_tokens_nth = 0;
+std::uint8_t g_hash_generation = 0; // Increased every search ( 6 bits )
 std::vector<std::string> g_tokens(256); // 300 plys init
 polyglotbook::PolyglotBook g_book{};
-std::unique_ptr<HashEntry[]> g_hash{};
+nnue::Network *g_nnue_nets[2]{}; // EvalFile / EvalFileSmall. Replaced only between searches
+HashBucket *g_hash = nullptr;
+std::unique_ptr<std::atomic<std::uint64_t>[]> g_eval_hash{}; // Shared by all search threads
+std::uint64_t g_eval_hash_n = 0;
+PageMode g_page_mode = PageMode::kTHP, g_hash_page_mode = PageMode::kOff; // Wanted / Obtained
+NodeCounter g_nodes[MAX_THREADS]{};
+
+// Search state ( Every thread has its own copy. 0 = Main thread )
+
+thread_local std::uint64_t g_black = 0, g_white = 0, g_both = 0, g_empty = 0, g_good = 0, g_pawn_sq = 0,
+  g_checkers = 0, g_pinned = 0, g_check_mask = 0, g_r50_positions[R50_ARR]{};
+
+thread_local std::uint16_t g_countermoves[13][64]{}; // [Last piece][Last to] -> Quiet reply that caused a cutoff
+
+thread_local SearchStack g_stack[MAX_SEARCH_DEPTH + MAX_Q_SEARCH_DEPTH]{};
+
+// Quiet move ordering. Butterfly: [wtm][from][to] / Continuation: [Earlier piece][Earlier to][Piece][To]
+thread_local std::int16_t g_history[2][64][64]{}, g_cont_history[13][64][13][64]{};
+
+thread_local int g_thread_id = 0, g_king_sq = 0, g_root_n = 0, g_moves_n = 0, g_q_depth = 0, g_depth = 0, g_best_score = 0,
+  g_nnue_pieces[64]{}, g_nnue_squares[64]{};
+
+thread_local bool g_nullmove_active = false, g_classical = true;
+
+thread_local int g_nnue_net = 0; // Net of this search: 0 = EvalFile / 1 = EvalFileSmall
+
+thread_local std::uint16_t g_move_list[MAX_SEARCH_DEPTH + MAX_Q_SEARCH_DEPTH][MAX_MOVES]{}, *g_moves = nullptr;
+
+thread_local std::int32_t g_move_scores[MAX_SEARCH_DEPTH + MAX_Q_SEARCH_DEPTH][MAX_MOVES]{}, *g_scores = nullptr;
+
+thread_local Board g_board_empty{}, *g_board = nullptr, *g_board_orig = nullptr,
+  g_boards[MAX_SEARCH_DEPTH + MAX_Q_SEARCH_DEPTH]{}; // Copy-on-make: 1 board per ply
+
+// NNUE accumulators follow the boards: [0] = Root / [ply + 1] = g_boards[ply]. Computed lazily
+thread_local nnue::Accumulator g_accumulators[MAX_SEARCH_DEPTH + MAX_Q_SEARCH_DEPTH + 1]{};
+thread_local const Board *g_accumulator_parents[MAX_SEARCH_DEPTH + MAX_Q_SEARCH_DEPTH]{}; // Board made from
+thread_local std::uint64_t g_accumulator_root = 0; // Root hash when computed
 
 // Prototypes
 
 int SearchW(int, const int, const int, const int);
 int SearchB(const int, int, const int, const int);
 int QSearchB(const int, int, const int, const int);
+void MakeMove(const bool, Board*, const int, const std::uint16_t);
 int Evaluate(const bool);
 bool ChecksW();
 bool ChecksB();
+void ClearEvalHash();
 std::uint64_t GetRookMagicMoves(const int, const std::uint64_t);
 std::uint64_t GetBishopMagicMoves(const int, const std::uint64_t);
 
@@ -513,6 +675,24 @@ inline constexpr std::uint64_t Bit(const int nth) {
   return 0x1ULL << nth;
 }
 
+// From (6b) + To (6b) + Type (4b)
+inline std::uint16_t MakeMove16(const int from, const int to, const int type) {
+  return static_cast<std::uint16_t>(from | (to << 6) | (type << 12));
+}
+
+inline int MoveFrom(const std::uint16_t move) {
+  return move & 0x3F;
+}
+
+inline int MoveTo(const std::uint16_t move) {
+  return (move >> 6) & 0x3F;
+}
+
+// Type ( 0:Normal 1:OOw 2:OOOw 3:OOb 4:OOOb 5:=n 6:=b 7:=r 8:=q )
+inline int MoveType(const std::uint16_t move) {
+  return move >> 12;
+}
+
 // Count rightmost zeros AND then pop BitBoard
 inline int CtzrPop(std::uint64_t *b) {
   const int ret = std::countr_zero(*b); // 1011000 -> 3
@@ -535,6 +715,34 @@ std::uint64_t Nps(const std::uint64_t nodes, const std::uint64_t ms) {
   return static_cast<std::uint64_t>(1000 * nodes) / std::max<std::uint64_t>(1, ms);
 }
 
+// struct NodeCounter
+
+// Only the owner thread writes -> Relaxed load + store is enough
+void NodeCounter::add() {
+  this->n.store(this->n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void NodeCounter::add_eval(const bool hit) {
+  this->eval_probes.store(this->eval_probes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  if (hit) this->eval_hits.store(this->eval_hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// One counter summed over all threads
+std::uint64_t SumCounters(std::atomic<std::uint64_t> NodeCounter::*counter) {
+  std::uint64_t sum = 0;
+  for (auto i = 0; i < g_threads; i += 1) sum += (g_nodes[i].*counter).load(std::memory_order_relaxed);
+  return sum;
+}
+
+// Visited nodes of all threads
+std::uint64_t Nodes() {
+  return SumCounters(&NodeCounter::n);
+}
+
+void ResetNodes() {
+  for (auto &counter : g_nodes) counter.n = counter.eval_probes = counter.eval_hits = 0;
+}
+
 // Is (x, y) on board ? Slow, but only for init
 bool IsOnBoard(const int x, const int y) {
   return x >= 0 && x <= 7 && y >= 0 && y <= 7;
@@ -618,7 +826,7 @@ std::uint64_t Random8x64() {
 
 // Nondeterministic Rand()
 int Random(const int min, const int max) {
-  static std::uint64_t seed = 0x202c7ULL + static_cast<std::uint64_t>(std::time(nullptr));
+  thread_local std::uint64_t seed = 0x202c7ULL + static_cast<std::uint64_t>(std::time(nullptr));
   if (min == max) return min;
   if (min > max) return Random(max, min);
   seed = (seed << 5) ^ (seed + 1) ^ (seed >> 3);
@@ -686,21 +894,127 @@ void ReadInput() {
 // PolyGlot Book lib
 
 void SetBook(const std::string &book_file = BOOK_FILE) {
+#ifdef MAYHEMEMBED
+  if (book_file == BOOK_FILE) { // Embedded
+    g_book_exist = USE_BOOK && g_book.open_book(gBookData, gBookSize);
+    return;
+  }
+#endif
   g_book_exist = USE_BOOK && (book_file.length() <= 1 ? false : g_book.open_book(book_file));
 }
 
 // NNUE lib
 
-void SetNNUE(const std::string &eval_file = EVAL_FILE) {
-  g_classical = USE_NNUE && (!(g_nnue_exist = eval_file.length() <= 1 ? false : nnue::nnue_init(eval_file.c_str())));
+// The new net is loaded to the side and swapped in complete. Then the old one is freed
+void SetNNUE(const std::string &eval_file = EVAL_FILE, const int n = 0) {
+  char layout[NNUE_LAYOUT_SIZE]{};
+  auto *net = USE_NNUE && eval_file.length() > 1 ? nnue::nnue_load(eval_file.c_str(), layout) : nullptr;
+  if (!net && layout[0] && std::string(layout) != nnue::nnue_kernels())
+    std::cout << "info string NNUE file is laid out for " << layout << ", this binary runs " <<
+      nnue::nnue_kernels() << ". Convert it again" << std::endl;
+  nnue::nnue_free(std::exchange(g_nnue_nets[n], net));
+  g_nnue_net = 0; // Next search picks again
+  g_accumulators[0].computedAccumulation = false; // New weights
+  g_classical = USE_NNUE && (!(g_nnue_exist = g_nnue_nets[0] != nullptr));
+  ClearEvalHash();
 }
 
 // Hashtable
 
+const std::string PageModeName(const PageMode mode) {
+  switch (mode) {
+    case PageMode::kHugeTLB: return "HugeTLB";
+    case PageMode::kTHP:     return "THP";
+    default:                 return "Off";
+  }
+}
+
+void FreeHashtable() {
+  if (!g_hash) return;
+  #ifndef WINDOWS
+    if (g_hash_page_mode == PageMode::kHugeTLB) {
+      munmap(g_hash, g_hash_buckets * sizeof(HashBucket));
+      g_hash = nullptr;
+      return;
+    }
+  #endif
+  std::free(g_hash);
+  g_hash = nullptr;
+}
+
+// Explicit huge pages. Needs reserved pages ( /proc/sys/vm/nr_hugepages )
+bool AllocHugeTLB(const std::size_t bytes) {
+  #if !defined(WINDOWS) && defined(MAP_HUGETLB)
+    void *mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem == MAP_FAILED) return false;
+    g_hash           = static_cast<HashBucket*>(mem);
+    g_hash_page_mode = PageMode::kHugeTLB;
+    return true;
+  #else
+    (void)bytes;
+    return false;
+  #endif
+}
+
+// Aligned to huge pages so THP can back the whole table
+void AllocAligned(const std::size_t bytes, const bool thp) {
+  g_hash = static_cast<HashBucket*>(std::aligned_alloc(HUGE_PAGE, bytes));
+  if (!g_hash) throw std::runtime_error("info string ( #12 ) Hashtable allocation failed");
+  g_hash_page_mode = PageMode::kOff;
+  #if !defined(WINDOWS) && defined(MADV_HUGEPAGE)
+    if (thp && !madvise(g_hash, bytes, MADV_HUGEPAGE)) g_hash_page_mode = PageMode::kTHP;
+  #else
+    (void)thp;
+  #endif
+}
+
+// Zero the table on all cores. Also the first touch of fresh pages
+std::uint32_t ClearHashtable() {
+  const std::uint32_t n = std::clamp<std::uint32_t>(std::thread::hardware_concurrency(), 1, MAX_THREADS);
+  const std::uint64_t chunk = (g_hash_buckets + n - 1) / n;
+  std::vector<std::thread> threads;
+  for (std::uint32_t i = 0; i < n; ++i)
+    threads.emplace_back([i, chunk]() {
+      const auto start = std::min<std::uint64_t>(i * chunk, g_hash_buckets);
+      const auto end   = std::min<std::uint64_t>(start + chunk, g_hash_buckets);
+      std::memset(static_cast<void*>(g_hash + start), 0, (end - start) * sizeof(HashBucket));
+    });
+  for (auto &thread : threads) thread.join();
+  g_hash_generation = 0;
+  return n;
+}
+
+// Eval cache: Slot = Position key (48b) + Eval (16b) -> 1 atomic word. No locks / No torn entries
+void ClearEvalHash() {
+  for (std::uint64_t i = 0; i < g_eval_hash_n; i += 1) g_eval_hash[i].store(0, std::memory_order_relaxed);
+}
+
+void SetEvalHash(const int eval_hash_mb2 = DEF_EVAL_HASH_MB) {
+  const int eval_hash_mb = std::clamp(eval_hash_mb2, 1, 4096);
+  g_eval_hash_n = (static_cast<std::uint64_t>(eval_hash_mb) << 20) / sizeof(std::uint64_t);
+  g_eval_hash   = std::make_unique<std::atomic<std::uint64_t>[]>(g_eval_hash_n); // Zeroed
+}
+
+void ClearHash() {
+  const auto start   = Now();
+  const auto threads = ClearHashtable();
+  ClearEvalHash();
+  std::cout << "info string Hash cleared in " << (Now() - start) << " ms ( Threads: " << threads << " )" << std::endl;
+}
+
 void SetHashtable(const int hash_mb2 = DEF_HASH_MB) {
   const int hash_mb = std::clamp(hash_mb2, 1, 1048576); // Limits 1MB -> 1TB
-  g_hash_entries = static_cast<std::uint32_t>((1 << 20) * hash_mb) / (sizeof(HashEntry)); // Hash(B) / Block(B)
-  g_hash.reset(new HashEntry[g_hash_entries]); // Claim space
+  // Whole huge pages only
+  const auto bytes  = ((static_cast<std::size_t>(hash_mb) << 20) + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+  const auto start   = Now();
+  FreeHashtable();
+  g_hash_buckets = bytes / sizeof(HashBucket); // Hash(B) / Block(B)
+  if (g_page_mode != PageMode::kHugeTLB || !AllocHugeTLB(bytes)) // Fallback to aligned memory
+    AllocAligned(bytes, g_page_mode != PageMode::kOff);
+  const auto threads = ClearHashtable();
+  std::cout << "info string Hash " << hash_mb << " MiB ( Pages: " << PageModeName(g_hash_page_mode) <<
+    " / Wanted: " << PageModeName(g_page_mode) << " ) allocated + cleared in " << (Now() - start) <<
+    " ms ( Threads: " << threads << " )" << std::endl;
 }
 
 // Hash
@@ -717,24 +1031,78 @@ std::uint64_t Hash(const bool wtm) {
 
 // struct HashEntry
 
-// Update hashtable sorting algorithm
-template <MoveType type>
-void HashEntry::update(const std::uint64_t hash, const std::uint8_t index) {
-  if constexpr (type == MoveType::kKiller) {
-    this->killer_hash = static_cast<std::uint32_t>(hash >> 32);
-    this->killer      = index + 1;
-  } else { // == MoveType::kGood !
-    this->good_hash = static_cast<std::uint32_t>(hash >> 32);
-    this->good      = index + 1;
+__extension__ typedef unsigned __int128 uint128_t;
+
+// Multiply-high -> [0, buckets) w/o division
+HashBucket* GetHashBucket(const std::uint64_t hash) {
+  return &g_hash[static_cast<std::uint64_t>((static_cast<uint128_t>(hash) * g_hash_buckets) >> 64)];
+}
+
+Bound HashEntry::bound() const {
+  return static_cast<Bound>(this->genbound & 0x3);
+}
+
+// Searches since stored
+int HashEntry::age() const {
+  return (g_hash_generation - (this->genbound >> 2)) & 0x3F;
+}
+
+// Value for the replacement ( Empty < Old / Shallow < New / Deep )
+int HashEntry::worth() const {
+  return this->bound() == Bound::kNone ? -1024 : this->depth - 8 * this->age();
+}
+
+bool HashEntry::is_ok(const std::uint64_t hash) const {
+  return this->bound() != Bound::kNone && this->key == static_cast<std::uint32_t>(hash);
+}
+
+bool HashEntry::cutoff(const std::uint64_t hash, const int alpha, const int beta, const int depth2) const {
+  if (!this->is_ok(hash) || this->depth < depth2) return false;
+  switch (this->bound()) {
+    case Bound::kExact: return true;
+    case Bound::kLower: return this->score >= beta;
+    case Bound::kUpper: return this->score <= alpha;
+    default:            return false;
   }
 }
 
-// Best moves put first for maximum cutoffs
-void HashEntry::put_hash_value_to_moves(const std::uint64_t hash, Board *moves) const {
-  if (this->killer && (this->killer_hash == static_cast<std::uint32_t>(hash >> 32)))
-    moves[this->killer - 1].score += 10000;
-  if (this->good && (this->good_hash == static_cast<std::uint32_t>(hash >> 32)))
-    moves[this->good - 1].score += 7000;
+int HashEntry::static_eval(const std::uint64_t hash) const {
+  return this->is_ok(hash) ? this->eval : NO_EVAL;
+}
+
+// Best move is searched first for maximum cutoffs
+std::uint16_t HashEntry::best_move(const std::uint64_t hash) const {
+  return this->is_ok(hash) ? this->move : 0;
+}
+
+// struct HashBucket
+
+HashEntry HashBucket::find(const std::uint64_t hash) const {
+  for (const auto &entry : this->entries)
+    if (entry.is_ok(hash)) return entry; // Copy ( Other threads write too )
+  return {};
+}
+
+// Same position or the least valuable: Shallow and old entries go first
+void HashBucket::store(const std::uint64_t hash, const int score, const int eval, const int depth,
+    const Bound bound, const std::uint16_t move) {
+  auto *replace = this->entries + 0;
+  for (auto &entry : this->entries) {
+    if (entry.is_ok(hash)) {
+      replace = &entry;
+      // Keep deeper non-exact results from this search
+      if (bound != Bound::kExact && depth + 2 < entry.depth && !entry.age()) return;
+      break;
+    }
+    if (entry.worth() < replace->worth()) replace = &entry;
+  }
+
+  if (move || !replace->is_ok(hash)) replace->move = move; // Keep old move if none
+  replace->key      = static_cast<std::uint32_t>(hash);
+  replace->score    = score;
+  replace->eval     = static_cast<std::int16_t>(std::clamp(eval, NO_EVAL, -NO_EVAL - 1));
+  replace->depth    = static_cast<std::uint8_t>(std::clamp(depth, 0, 255));
+  replace->genbound = static_cast<std::uint8_t>((g_hash_generation << 2) | static_cast<std::uint8_t>(bound));
 }
 
 // struct Board
@@ -751,6 +1119,10 @@ bool Board::is_castling() const {
   }
 }
 
+bool Board::is_nullmove() const {
+  return this->type == 9;
+}
+
 bool Board::is_underpromo() const {
   switch (this->type) {
     // e7e8n / e7e8n / e7e8r
@@ -759,20 +1131,30 @@ bool Board::is_underpromo() const {
   }
 }
 
-const std::string Board::movename() const {
-  switch (this->type) {
+// Last move ( See: MakeMove16 )
+std::uint16_t Board::move16() const {
+  return MakeMove16(this->from, this->to, this->type);
+}
+
+const std::string MoveName(const std::uint16_t move) {
+  const auto from = MoveFrom(move), to = MoveTo(move);
+  switch (MoveType(move)) {
     case 1:  return MakeMove2Str(g_king_w, g_chess960 ? g_rook_w[0] : 6);      // O-Ow
     case 2:  return MakeMove2Str(g_king_w, g_chess960 ? g_rook_w[1] : 2);      // O-O-Ow
     case 3:  return MakeMove2Str(g_king_b, g_chess960 ? g_rook_b[0] : 56 + 6); // O-Ob
     case 4:  return MakeMove2Str(g_king_b, g_chess960 ? g_rook_b[1] : 56 + 2); // O-O-Ob
-    case 5:  return MakeMove2Str(this->from, this->to) + 'n'; // e7e8n
-    case 6:  return MakeMove2Str(this->from, this->to) + 'b'; // e7e8b
-    case 7:  return MakeMove2Str(this->from, this->to) + 'r'; // e7e8r
-    case 8:  return MakeMove2Str(this->from, this->to) + 'q'; // e7e8q
-    default: return MakeMove2Str(this->from, this->to); // Normal
+    case 5:  return MakeMove2Str(from, to) + 'n'; // e7e8n
+    case 6:  return MakeMove2Str(from, to) + 'b'; // e7e8b
+    case 7:  return MakeMove2Str(from, to) + 'r'; // e7e8r
+    case 8:  return MakeMove2Str(from, to) + 'q'; // e7e8q
+    default: return MakeMove2Str(from, to); // Normal
   }
 }
 
+const std::string Board::movename() const {
+  return MoveName(this->move16());
+}
+
 char GetPiece(const int piece) {
   switch (piece) {
     case +1: return 'P';
@@ -1110,6 +1492,7 @@ void FenGen(std::string fen) {
   FenRule50(tokens[4]);
   FenFullMoves(tokens[5]);
   FenBuildCastlingBitboards();
+  g_board->hash = Hash(g_wtm);
 }
 
 // Reset board
@@ -1143,8 +1526,7 @@ void SetFen(const std::string &fen = STARTPOS) {
 
 // Checks
 
-bool ChecksHereW(const int sq) {
-  const auto both = Both();
+bool ChecksHereW(const int sq, const std::uint64_t both = Both()) {
   return (g_pawn_checks_b[sq]           &  g_board->white[0]) |
          (g_knight_moves[sq]            &  g_board->white[1]) |
          (GetBishopMagicMoves(sq, both) & (g_board->white[2] | g_board->white[4])) |
@@ -1152,8 +1534,7 @@ bool ChecksHereW(const int sq) {
          (g_king_moves[sq]              &  g_board->white[5]);
 }
 
-bool ChecksHereB(const int sq) {
-  const auto both = Both();
+bool ChecksHereB(const int sq, const std::uint64_t both = Both()) {
   return (g_pawn_checks_w[sq]           &  g_board->black[0]) |
          (g_knight_moves[sq]            &  g_board->black[1]) |
          (GetBishopMagicMoves(sq, both) & (g_board->black[2] | g_board->black[4])) |
@@ -1183,61 +1564,195 @@ bool ChecksB() {
   return ChecksHereB(std::countr_zero(g_board->white[5]));
 }
 
+// Does a quiet move check ( Direct or discovered ) ? Tested on the parent w/o making it
+// Castling -> Rare and messy ( Chess960 ) -> Make it and see
+bool QuietChecksW(const int ply, const std::uint16_t move) {
+  if (MoveType(move)) {
+    auto *parent = g_board;
+    MakeMove(true, parent, ply, move);
+    const auto checks = ChecksW();
+    g_board = parent;
+    return checks;
+  }
+  const auto from = MoveFrom(move), to = MoveTo(move), ksq = std::countr_zero(g_board->black[5]);
+  const auto both = (Both() ^ Bit(from)) | Bit(to), king = Bit(ksq);
+  switch (g_board->pieces[from]) {
+    case 1: if (g_pawn_checks_w[to] & king) return true; break;
+    case 2: if (g_knight_moves[to] & king) return true; break;
+    case 3: if (GetBishopMagicMoves(to, both) & king) return true; break;
+    case 4: if (GetRookMagicMoves(to, both) & king) return true; break;
+    case 5: if ((GetBishopMagicMoves(to, both) | GetRookMagicMoves(to, both)) & king) return true; break;
+  }
+  return ((GetBishopMagicMoves(ksq, both) & (g_board->white[2] | g_board->white[4])) |
+          (GetRookMagicMoves(ksq, both)   & (g_board->white[3] | g_board->white[4]))) & ~Bit(from);
+}
+
+bool QuietChecksB(const int ply, const std::uint16_t move) {
+  if (MoveType(move)) {
+    auto *parent = g_board;
+    MakeMove(false, parent, ply, move);
+    const auto checks = ChecksB();
+    g_board = parent;
+    return checks;
+  }
+  const auto from = MoveFrom(move), to = MoveTo(move), ksq = std::countr_zero(g_board->white[5]);
+  const auto both = (Both() ^ Bit(from)) | Bit(to), king = Bit(ksq);
+  switch (g_board->pieces[from]) {
+    case -1: if (g_pawn_checks_b[to] & king) return true; break;
+    case -2: if (g_knight_moves[to] & king) return true; break;
+    case -3: if (GetBishopMagicMoves(to, both) & king) return true; break;
+    case -4: if (GetRookMagicMoves(to, both) & king) return true; break;
+    case -5: if ((GetBishopMagicMoves(to, both) | GetRookMagicMoves(to, both)) & king) return true; break;
+  }
+  return ((GetBishopMagicMoves(ksq, both) & (g_board->black[2] | g_board->black[4])) |
+          (GetRookMagicMoves(ksq, both)   & (g_board->black[3] | g_board->black[4]))) & ~Bit(from);
+}
+
+// Static exchange evaluation
+
+// All pieces of both sides hitting sq
+std::uint64_t AttackersTo(const int sq, const std::uint64_t both) {
+  return (g_pawn_checks_b[sq]           &  g_board->white[0]) |
+         (g_pawn_checks_w[sq]           &  g_board->black[0]) |
+         (g_knight_moves[sq]            & (g_board->white[1] | g_board->black[1])) |
+         (GetBishopMagicMoves(sq, both) & (g_board->white[2] | g_board->black[2] | g_board->white[4] | g_board->black[4])) |
+         (GetRookMagicMoves(sq, both)   & (g_board->white[3] | g_board->black[3] | g_board->white[4] | g_board->black[4])) |
+         (g_king_moves[sq]              & (g_board->white[5] | g_board->black[5]));
+}
+
+// Cheapest attacker of one side -> Its type ( 0-5 ) and square. -1 = No attackers
+int LeastValuableAttacker(const std::uint64_t attackers, const std::uint64_t *pieces, std::uint64_t *from) {
+  for (auto i = 0; i < 6; i += 1)
+    if (const auto m = attackers & pieces[i]; m) {
+      *from = m & -m;
+      return i;
+    }
+  return -1;
+}
+
+// Material won or lost by the capture sequence on 'to' ( Swap list. Pins are ignored )
+int See(const bool wtm, const int from, const int to) {
+  int gain[32]{}, d = 0;
+  auto both      = Both();
+  auto attackers = AttackersTo(to, both);
+  auto from_bb   = Bit(from);
+  auto piece     = std::abs(g_board->pieces[from]) - 1;
+  auto side      = wtm;
+  gain[0]        = g_board->pieces[to] ? kSee[std::abs(g_board->pieces[to]) - 1] : kSee[0]; // En passant
+  do {
+    d      += 1;
+    gain[d] = kSee[piece] - gain[d - 1]; // Score if this piece is taken next
+    if (std::max(-gain[d - 1], gain[d]) < 0) break; // Loses either way -> Stop
+    both      ^= from_bb;
+    attackers ^= from_bb;
+    // X-rays behind the moved piece
+    if (piece == 0 || piece == 2 || piece == 4)
+      attackers |= GetBishopMagicMoves(to, both) & (g_board->white[2] | g_board->black[2] | g_board->white[4] | g_board->black[4]);
+    if (piece == 3 || piece == 4)
+      attackers |= GetRookMagicMoves(to, both) & (g_board->white[3] | g_board->black[3] | g_board->white[4] | g_board->black[4]);
+    attackers &= both;
+    side       = !side;
+    piece      = LeastValuableAttacker(attackers, side ? g_board->white : g_board->black, &from_bb);
+  } while (piece != -1 && d < 31);
+  while (--d) gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+  return gain[0];
+}
+
+// =q / Capture not losing material ( Cheap victim >= attacker test first )
+bool IsGoodCapture(const bool wtm, const std::uint16_t move) {
+  const auto from = MoveFrom(move), to = MoveTo(move), type = MoveType(move);
+  if (type) return type == 8;
+  const auto me  = std::abs(g_board->pieces[from]);
+  const auto eat = std::abs(g_board->pieces[to]);
+  if (!eat || kSee[eat - 1] >= kSee[me - 1]) return true; // En passant / Good trade
+  return See(wtm, from, to) >= 0;
+}
+
 // Sorting
 
 // Sort only one node at a time ( Avoid the costly n! of operations ! )
 // Swap every node for simplicity ( See: lazy-sorting-algorithm paper )
 void LazySort(const int ply, const int nth, const int total_moves) {
   for (auto i = nth + 1; i < total_moves; i += 1)
-    if (g_boards[ply][i].score > g_boards[ply][nth].score)
-      std::swap(g_boards[ply][nth], g_boards[ply][i]);
+    if (g_move_scores[ply][i] > g_move_scores[ply][nth]) {
+      std::swap(g_move_scores[ply][nth], g_move_scores[ply][i]);
+      std::swap(g_move_list[ply][nth], g_move_list[ply][i]);
+    }
 }
 
 // 1. Evaluate all root moves
 void EvalRootMoves() {
   for (auto i = 0; i < g_root_n; i += 1) {
-    g_board         = g_boards[0] + i; // Pointer to this board
-    g_board->score += (g_board->is_queen_promo() ? 1000  : 0) +
-                      (g_board->is_castling()    ? 100   : 0) +
-                      (g_board->is_underpromo()  ? -5000 : 0) +
-                      (Random(-g_noise, +g_noise)) +       // Add noise -> Make unpredictable
-                      (g_wtm ? +1 : -1) * Evaluate(g_wtm); // Full eval
+    MakeMove(g_wtm, &g_board_empty, 0, g_move_list[0][i]); // Board of this move
+    g_move_scores[0][i] += (g_board->is_queen_promo() ? 1000  : 0) +
+                           (g_board->is_castling()    ? 100   : 0) +
+                           (g_board->is_underpromo()  ? -5000 : 0) +
+                           (Random(-g_noise, +g_noise)) +       // Add noise -> Make unpredictable
+                           (g_wtm ? +1 : -1) * Evaluate(g_wtm); // Full eval
   }
+  g_board = &g_board_empty;
 }
 
 // struct RootCompFunctor
 
-// 2. Then sort root moves
-bool RootCompFunctor::operator()(const Board &a, const Board &b) const {
-  return a.score > b.score;
+// 2. Then sort root moves ( Score + Move )
+bool RootCompFunctor::operator()(const std::pair<int, std::uint16_t> &a, const std::pair<int, std::uint16_t> &b) const {
+  return a.first > b.first;
 }
 
 // 9 -> 0
 void SortRootMoves() {
-  std::sort(g_boards[0] + 0, g_boards[0] + g_root_n, RootCompFunctor());
+  std::vector< std::pair<int, std::uint16_t> > root(g_root_n);
+  for (auto i = 0; i < g_root_n; i += 1) root[i] = {g_move_scores[0][i], g_move_list[0][i]};
+  std::sort(root.begin(), root.end(), RootCompFunctor());
+  for (auto i = 0; i < g_root_n; i += 1) std::tie(g_move_scores[0][i], g_move_list[0][i]) = root[i];
 }
 
 void SortRoot(const int index) {
   if (!index) return;
-  const auto tmp = g_boards[0][index];
-  for (auto i = index; i > 0; i -= 1)
-    g_boards[0][i] = g_boards[0][i - 1];
-  g_boards[0][0] = tmp;
+  std::rotate(g_move_list[0] + 0, g_move_list[0] + index, g_move_list[0] + index + 1);
+  std::rotate(g_move_scores[0] + 0, g_move_scores[0] + index, g_move_scores[0] + index + 1);
 }
 
 void SwapMoveInRootList(const int index) {
   if (!index) return;
-  std::swap(g_boards[0][0], g_boards[0][index]);
+  std::swap(g_move_list[0][0], g_move_list[0][index]);
+  std::swap(g_move_scores[0][0], g_move_scores[0][index]);
 }
 
 // Move generator
 
+// BMI2 ( CPUID ). Not AMD before Zen 3: PEXT is microcoded there and slower than magics
+bool HasFastPext() {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("bmi2")) return false;
+  unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+  __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+  const auto family = ((eax >> 8) & 0xF) + ((eax >> 20) & 0xFF);
+  return !(__builtin_cpu_is("amd") && family < 0x19);
+#else
+  return false;
+#endif
+}
+
+// Gather the mask bits of b to the bottom. asm: The build itself needs no -mbmi2
+inline std::uint64_t Pext(const std::uint64_t b, const std::uint64_t mask) {
+#if defined(__x86_64__)
+  std::uint64_t ret;
+  asm("pextq %2, %1, %0" : "=r" (ret) : "r" (b), "r" (mask));
+  return ret;
+#else
+  return b & mask; // Never used ( !g_pext )
+#endif
+}
+
 std::uint64_t GetBishopMagicIndex(const int sq, const std::uint64_t mask) {
-  return ((mask & kBishopMagics[1][sq]) * kBishopMagics[0][sq]) >> 55;
+  return g_pext ? Pext(mask, kBishopMagics[1][sq]) : ((mask & kBishopMagics[1][sq]) * kBishopMagics[0][sq]) >> 55;
 }
 
 std::uint64_t GetRookMagicIndex(const int sq, const std::uint64_t mask) {
-  return ((mask & kRookMagics[1][sq]) * kRookMagics[0][sq]) >> 52;
+  return g_pext ? Pext(mask, kRookMagics[1][sq]) : ((mask & kRookMagics[1][sq]) * kRookMagics[0][sq]) >> 52;
 }
 
 std::uint64_t GetBishopMagicMoves(const int sq, const std::uint64_t mask) {
@@ -1248,104 +1763,46 @@ std::uint64_t GetRookMagicMoves(const int sq, const std::uint64_t mask) {
   return g_rook_magic_moves[sq][GetRookMagicIndex(sq, mask)];
 }
 
-void HandleCastlingW(const int mtype, const int from, const int to) {
-  g_moves[g_moves_n] = *g_board; // Copy board
-  g_board            = &g_moves[g_moves_n]; // Set pointer
-  g_board->score     = 0;
-  g_board->epsq      = -1;
-  g_board->from      = from;
-  g_board->to        = to;
-  g_board->type      = mtype;
-  g_board->castle   &= 0x4 | 0x8;
-  g_board->fifty     = 0;
-}
+// Incremental hashing
 
-void HandleCastlingB(const int mtype, const int from, const int to) {
-  g_moves[g_moves_n] = *g_board;
-  g_board            = &g_moves[g_moves_n];
-  g_board->score     = 0;
-  g_board->epsq      = -1;
-  g_board->from      = from;
-  g_board->to        = to;
-  g_board->type      = mtype;
-  g_board->castle   &= 0x1 | 0x2;
-  g_board->fifty     = 0;
+inline void HashPiece(const int piece, const int sq) {
+  g_board->hash ^= g_zobrist_board[piece + 6][sq];
 }
 
-void AddCastleOOW() {
-  if (ChecksCastleB(g_castle_no_checks_w[0])) return;
-
-  HandleCastlingW(1, g_king_w, 6);
-  g_board->pieces[g_rook_w[0]] = 0;
-  g_board->pieces[g_king_w]    = 0;
-  g_board->pieces[5]           = +4;
-  g_board->pieces[6]           = +6;
-  g_board->white[3]            = (g_board->white[3] ^ Bit(g_rook_w[0])) | Bit(5);
-  g_board->white[5]            = (g_board->white[5] ^ Bit(g_king_w))    | Bit(6);
-
-  if (ChecksB()) return;
-  g_board->index = g_moves_n;
-  g_moves_n     += 1;
+// Side to move + En passant + Castling rights changes vs parent
+inline void HashSpecial() {
+  g_board->hash ^= g_zobrist_wtm[0]                         ^ g_zobrist_wtm[1]                    ^
+                   g_zobrist_ep[g_board_orig->epsq + 1]     ^ g_zobrist_ep[g_board->epsq + 1]     ^
+                   g_zobrist_castle[g_board_orig->castle]   ^ g_zobrist_castle[g_board->castle];
 }
 
-void AddCastleOOB() {
-  if (ChecksCastleW(g_castle_no_checks_b[0])) return;
-
-  HandleCastlingB(3, g_king_b, 56 + 6);
-  g_board->pieces[g_rook_b[0]] = 0;
-  g_board->pieces[g_king_b]    = 0;
-  g_board->pieces[56 + 5]      = -4;
-  g_board->pieces[56 + 6]      = -6;
-  g_board->black[3]            = (g_board->black[3] ^ Bit(g_rook_b[0])) | Bit(56 + 5);
-  g_board->black[5]            = (g_board->black[5] ^ Bit(g_king_b))    | Bit(56 + 6);
+// Move list ( 16-bit moves + Sorting scores ). Boards are made only when searched
 
-  if (ChecksW()) return;
-  g_board->index = g_moves_n;
-  g_moves_n     += 1;
+void AddMove(const int from, const int to, const int type, const int score) {
+  g_moves[g_moves_n]  = MakeMove16(from, to, type);
+  g_scores[g_moves_n] = score;
+  g_moves_n          += 1;
 }
 
-void AddCastleOOOW() {
-  if (ChecksCastleB(g_castle_no_checks_w[1])) return;
-
-  HandleCastlingW(2, g_king_w, 2);
-  g_board->pieces[g_rook_w[1]] = 0;
-  g_board->pieces[g_king_w]    = 0;
-  g_board->pieces[3]           = +4;
-  g_board->pieces[2]           = +6;
-  g_board->white[3]            = (g_board->white[3] ^ Bit(g_rook_w[1])) | Bit(3);
-  g_board->white[5]            = (g_board->white[5] ^ Bit(g_king_w))    | Bit(2);
-
-  if (ChecksB()) return;
-  g_board->index = g_moves_n;
-  g_moves_n     += 1;
+// Castled king can't be in check ( Chess960: Moved rook might have been blocking )
+bool CastleOkW(const int rook, const int king_to, const int rook_to) {
+  return !ChecksHereB(king_to, (g_both ^ Bit(g_king_w) ^ Bit(rook)) | Bit(king_to) | Bit(rook_to));
 }
 
-void AddCastleOOOB() {
-  if (ChecksCastleW(g_castle_no_checks_b[1])) return;
-
-  HandleCastlingB(4, g_king_b, 56 + 2);
-  g_board->pieces[g_rook_b[1]] = 0;
-  g_board->pieces[g_king_b]    = 0;
-  g_board->pieces[56 + 3]      = -4;
-  g_board->pieces[56 + 2]      = -6;
-  g_board->black[3]            = (g_board->black[3] ^ Bit(g_rook_b[1])) | Bit(56 + 3);
-  g_board->black[5]            = (g_board->black[5] ^ Bit(g_king_b))    | Bit(56 + 2);
-
-  if (ChecksW()) return;
-  g_board->index = g_moves_n;
-  g_moves_n     += 1;
+bool CastleOkB(const int rook, const int king_to, const int rook_to) {
+  return !ChecksHereW(king_to, (g_both ^ Bit(g_king_b) ^ Bit(rook)) | Bit(king_to) | Bit(rook_to));
 }
 
 void AddOOW() {
-  if (!(g_board->castle & 0x1) || (g_castle_empty_w[0] & g_both)) return;
-  AddCastleOOW();
-  g_board = g_board_orig;
+  if (!(g_board->castle & 0x1) || (g_castle_empty_w[0] & g_both) ||
+      ChecksCastleB(g_castle_no_checks_w[0]) || !CastleOkW(g_rook_w[0], 6, 5)) return;
+  AddMove(g_king_w, 6, 1, 0);
 }
 
 void AddOOOW() {
-  if (!(g_board->castle & 0x2) || (g_castle_empty_w[1] & g_both)) return;
-  AddCastleOOOW();
-  g_board = g_board_orig;
+  if (!(g_board->castle & 0x2) || (g_castle_empty_w[1] & g_both) ||
+      ChecksCastleB(g_castle_no_checks_w[1]) || !CastleOkW(g_rook_w[1], 2, 3)) return;
+  AddMove(g_king_w, 2, 2, 0);
 }
 
 void MgenCastlingMovesW() {
@@ -1354,15 +1811,15 @@ void MgenCastlingMovesW() {
 }
 
 void AddOOB() {
-  if (!(g_board->castle & 0x4) || (g_castle_empty_b[0] & g_both)) return;
-  AddCastleOOB();
-  g_board = g_board_orig;
+  if (!(g_board->castle & 0x4) || (g_castle_empty_b[0] & g_both) ||
+      ChecksCastleW(g_castle_no_checks_b[0]) || !CastleOkB(g_rook_b[0], 56 + 6, 56 + 5)) return;
+  AddMove(g_king_b, 56 + 6, 3, 0);
 }
 
 void AddOOOB() {
-  if (!(g_board->castle & 0x8) || (g_castle_empty_b[1] & g_both)) return;
-  AddCastleOOOB();
-  g_board = g_board_orig;
+  if (!(g_board->castle & 0x8) || (g_castle_empty_b[1] & g_both) ||
+      ChecksCastleW(g_castle_no_checks_b[1]) || !CastleOkB(g_rook_b[1], 56 + 2, 56 + 3)) return;
+  AddMove(g_king_b, 56 + 2, 4, 0);
 }
 
 void MgenCastlingMovesB() {
@@ -1370,263 +1827,145 @@ void MgenCastlingMovesB() {
   AddOOOB();
 }
 
-void HandleCastlingRights() {
-  if (!g_board->castle) return;
-  if (g_board->pieces[g_king_w] != +6)    g_board->castle &= 0x4 | 0x8;
-  if (g_board->pieces[g_rook_w[0]] != +4) g_board->castle &= 0x2 | 0x4 | 0x8;
-  if (g_board->pieces[g_rook_w[1]] != +4) g_board->castle &= 0x1 | 0x4 | 0x8;
-  if (g_board->pieces[g_king_b] != -6)    g_board->castle &= 0x1 | 0x2;
-  if (g_board->pieces[g_rook_b[0]] != -4) g_board->castle &= 0x1 | 0x2 | 0x8;
-  if (g_board->pieces[g_rook_b[1]] != -4) g_board->castle &= 0x1 | 0x2 | 0x4;
-}
-
-void ModifyPawnStuffW(const int from, const int to) {
-  if (g_board->pieces[to] != +1) return;
+// Legal moves only ( Pins + checks ) -> Nothing illegal gets into the list
 
-  g_board->fifty = 0;
-  if (to == g_board_orig->epsq) {
-    g_board->score          = 10; // PxP
-    g_board->pieces[to - 8] = 0;
-    g_board->black[0]      ^= Bit(to - 8);
-  } else if (MakeY(from) == 1 && MakeY(to) == 3) { // e2e4 ...
-    g_board->epsq = to - 8;
-  } else if (MakeY(to) == 6) { // Bonus for 7th ranks
-    g_board->score = 91;
-  }
+// King can't step into checks ( King itself doesn't block sliders )
+std::uint64_t KingMovesW(std::uint64_t moves) {
+  const auto both = g_both ^ Bit(g_king_sq);
+  for (auto m = moves; m; )
+    if (const auto to = CtzrPop(&m); ChecksHereB(to, both)) moves ^= Bit(to);
+  return moves;
 }
 
-void ModifyPawnStuffB(const int from, const int to) {
-  if (g_board->pieces[to] != -1) return;
-
-  g_board->fifty = 0;
-  if (to == g_board_orig->epsq) {
-    g_board->score          = 10;
-    g_board->pieces[to + 8] = 0;
-    g_board->white[0]      ^= Bit(to + 8);
-  } else if (MakeY(from) == 6 && MakeY(to) == 4) {
-    g_board->epsq = to + 8;
-  } else if (MakeY(to) == 1) {
-    g_board->score = 91;
-  }
+std::uint64_t KingMovesB(std::uint64_t moves) {
+  const auto both = g_both ^ Bit(g_king_sq);
+  for (auto m = moves; m; )
+    if (const auto to = CtzrPop(&m); ChecksHereW(to, both)) moves ^= Bit(to);
+  return moves;
 }
 
-void AddPromotionW(const int from, const int to, const int piece) {
-  const auto eat = g_board->pieces[to];
-
-  g_moves[g_moves_n]         = *g_board;
-  g_board                    = &g_moves[g_moves_n];
-  g_board->from              = from;
-  g_board->to                = to;
-  g_board->score             = piece == +5 ? 115 : 0; // Bonus for =q only
-  g_board->type              = 3 + piece;
-  g_board->epsq              = -1;
-  g_board->fifty             = 0;
-  g_board->pieces[to]        = piece;
-  g_board->pieces[from]      = 0;
-  g_board->white[0]         ^= Bit(from);
-  g_board->white[piece - 1] |= Bit(to);
-
-  if (eat <= -1)  g_board->black[-eat - 1] ^= Bit(to);
-
-  if (ChecksB()) return;
-  HandleCastlingRights();
-  g_board->index = g_moves_n++;
+// En passant removes 2 pieces from the same rank -> Check the king directly
+bool EpOkW(const int from, const int to) {
+  const auto both = (g_both ^ Bit(from) ^ Bit(to - 8)) | Bit(to);
+  return !(g_checkers & (g_board->black[0] | g_board->black[1]) & ~Bit(to - 8)) &&
+         !(GetBishopMagicMoves(g_king_sq, both) & (g_board->black[2] | g_board->black[4])) &&
+         !(GetRookMagicMoves(g_king_sq, both)   & (g_board->black[3] | g_board->black[4]));
 }
 
-void AddPromotionB(const int from, const int to, const int piece) {
-  const auto eat = g_board->pieces[to];
-
-  g_moves[g_moves_n]          = *g_board;
-  g_board                     = &g_moves[g_moves_n];
-  g_board->from               = from;
-  g_board->to                 = to;
-  g_board->score              = piece == -5 ? 115 : 0;
-  g_board->type               = 3 + (-piece);
-  g_board->epsq               = -1;
-  g_board->fifty              = 0;
-  g_board->pieces[from]       = 0;
-  g_board->pieces[to]         = piece;
-  g_board->black[0]          ^= Bit(from);
-  g_board->black[-piece - 1] |= Bit(to);
-
-  if (eat >= +1)  g_board->white[eat - 1] ^= Bit(to);
-
-  if (ChecksW()) return;
-  HandleCastlingRights();
-  g_board->index = g_moves_n;
-  g_moves_n     += 1;
+bool EpOkB(const int from, const int to) {
+  const auto both = (g_both ^ Bit(from) ^ Bit(to + 8)) | Bit(to);
+  return !(g_checkers & (g_board->white[0] | g_board->white[1]) & ~Bit(to + 8)) &&
+         !(GetBishopMagicMoves(g_king_sq, both) & (g_board->white[2] | g_board->white[4])) &&
+         !(GetRookMagicMoves(g_king_sq, both)   & (g_board->white[3] | g_board->white[4]));
 }
 
-void AddPromotionW2(const int from, const int to, const int piece) {
-  AddPromotionW(from, to, piece);
-  g_board = g_board_orig;
+std::uint64_t LegalMovesW(const int from, std::uint64_t moves) {
+  if (from == g_king_sq) return KingMovesW(moves);
+  auto ep = 0ULL;
+  if (g_board->epsq > 0 && g_board->pieces[from] == +1 && (moves & Bit(g_board->epsq))) {
+    moves ^= Bit(g_board->epsq);
+    if (EpOkW(from, g_board->epsq)) ep = Bit(g_board->epsq);
+  }
+  moves &= g_check_mask;
+  if (g_pinned & Bit(from)) moves &= g_line[g_king_sq][from]; // Pinned -> Stay on the line
+  return moves | ep;
 }
 
-void AddPromotionB2(const int from, const int to, const int piece) {
-  AddPromotionB(from, to, piece);
-  g_board = g_board_orig;
+std::uint64_t LegalMovesB(const int from, std::uint64_t moves) {
+  if (from == g_king_sq) return KingMovesB(moves);
+  auto ep = 0ULL;
+  if (g_board->epsq > 0 && g_board->pieces[from] == -1 && (moves & Bit(g_board->epsq))) {
+    moves ^= Bit(g_board->epsq);
+    if (EpOkB(from, g_board->epsq)) ep = Bit(g_board->epsq);
+  }
+  moves &= g_check_mask;
+  if (g_pinned & Bit(from)) moves &= g_line[g_king_sq][from];
+  return moves | ep;
 }
 
-void AddPromotionStuff_NBRQ_W(const int from, const int to) {
+// Type: 5:=n 6:=b 7:=r 8:=q. Bonus for =q only
+void AddPromotionStuffW(const int from, const int to) {
   for (const auto p : {+5, +2, +4, +3})
-    AddPromotionW2(from, to, p);
+    if (g_underpromos || p == +5 || p == +2)
+      AddMove(from, to, 3 + p, p == +5 ? 115 : 0);
 }
 
-void AddPromotionStuff_NQ_W(const int from, const int to) {
-  for (const auto p : {+5, +2})
-    AddPromotionW2(from, to, p);
-}
-
-void AddPromotionStuffW(const int from, const int to) {
-  if (g_underpromos)
-    AddPromotionStuff_NBRQ_W(from, to);
-  else
-    AddPromotionStuff_NQ_W(from, to);
+void AddPromotionStuffB(const int from, const int to) {
+  for (const auto p : {-5, -2, -4, -3})
+    if (g_underpromos || p == -5 || p == -2)
+      AddMove(from, to, 3 - p, p == -5 ? 115 : 0);
 }
 
-void AddPromotionStuff_NBRQ_B(const int from, const int to) {
-  for (const auto p : {-5, -2, -4, -3})
-    AddPromotionB2(from, to, p);
+// MVV-LVA. Pawn moves: PxP (ep) / Bonus for 7th ranks
+void AddW(const int from, const int to) {
+  const auto me  = g_board->pieces[from];
+  const auto eat = g_board->pieces[to];
+  if (me == +1 && MakeY(from) == 6) {
+    AddPromotionStuffW(from, to);
+    return;
+  }
+  auto score = eat <= -1 ? kMvv[me - 1][-eat - 1] : 0;
+  if (me == +1) {
+    if (to == g_board->epsq) score = 10;
+    else if (MakeY(to) == 6) score = 91;
+  }
+  AddMove(from, to, 0, score);
 }
 
-void AddPromotionStuff_NQ_B(const int from, const int to) {
-  for (const auto p : {-5, -2})
-    AddPromotionB2(from, to, p);
+void AddB(const int from, const int to) {
+  const auto me  = g_board->pieces[from];
+  const auto eat = g_board->pieces[to];
+  if (me == -1 && MakeY(from) == 1) {
+    AddPromotionStuffB(from, to);
+    return;
+  }
+  auto score = eat >= +1 ? kMvv[-me - 1][eat - 1] : 0;
+  if (me == -1) {
+    if (to == g_board->epsq) score = 10;
+    else if (MakeY(to) == 1) score = 91;
+  }
+  AddMove(from, to, 0, score);
 }
 
-void AddPromotionStuffB(const int from, const int to) {
-  if (g_underpromos)
-    AddPromotionStuff_NBRQ_B(from, to);
-  else
-    AddPromotionStuff_NQ_B(from, to);
+void AddMovesW(const int from, std::uint64_t moves) {
+  for (moves = LegalMovesW(from, moves); moves; ) AddW(from, CtzrPop(&moves));
 }
 
-void CheckNormalCapturesW(const int me, const int eat, const int to) {
-  if (eat > -1) return;
-  g_board->black[-eat - 1] ^= Bit(to);
-  g_board->score            = kMvv[me - 1][-eat - 1];
-  g_board->fifty            = 0;
+void AddMovesB(const int from, std::uint64_t moves) {
+  for (moves = LegalMovesB(from, moves); moves; ) AddB(from, CtzrPop(&moves));
 }
 
-void CheckNormalCapturesB(const int me, const int eat, const int to) {
-  if (eat < +1) return;
-  g_board->white[eat - 1] ^= Bit(to);
-  g_board->score           = kMvv[-me - 1][eat - 1];
-  g_board->fifty           = 0;
+void MgenPawnsW() {
+  for (auto p = g_board->white[0]; p; ) {
+    const auto sq = CtzrPop(&p);
+    AddMovesW(sq, g_pawn_checks_w[sq] & g_pawn_sq);
+    if (MakeY(sq) == 1) {
+      if (g_pawn_1_moves_w[sq] & g_empty)
+        AddMovesW(sq, g_pawn_2_moves_w[sq] & g_empty);
+    } else {
+      AddMovesW(sq, g_pawn_1_moves_w[sq] & g_empty);
+    }
+  }
 }
 
-// If not under checks -> Handle castling rights -> Add move
-void AddMoveIfOkW() {
-  if (ChecksB()) return;
-  HandleCastlingRights();
-  g_board->index = g_moves_n;
-  g_moves_n     += 1;
+void MgenPawnsB() {
+  for (auto p = g_board->black[0]; p; ) {
+    const auto sq = CtzrPop(&p);
+    AddMovesB(sq, g_pawn_checks_b[sq] & g_pawn_sq);
+    if (MakeY(sq) == 6) {
+      if (g_pawn_1_moves_b[sq] & g_empty)
+        AddMovesB(sq, g_pawn_2_moves_b[sq] & g_empty);
+    } else {
+      AddMovesB(sq, g_pawn_1_moves_b[sq] & g_empty);
+    }
+  }
 }
 
-void AddMoveIfOkB() {
-  if (ChecksW()) return;
-  HandleCastlingRights();
-  g_board->index = g_moves_n;
-  g_moves_n     += 1;
-}
-
-void AddNormalStuffW(const int from, const int to) {
-  const auto me  = g_board->pieces[from];
-  const auto eat = g_board->pieces[to];
-
-  g_moves[g_moves_n]     = *g_board;
-  g_board                = &g_moves[g_moves_n];
-  g_board->from          = from;
-  g_board->to            = to;
-  g_board->score         = 0;
-  g_board->type          = 0;
-  g_board->epsq          = -1;
-  g_board->pieces[from]  = 0;
-  g_board->pieces[to]    = me;
-  g_board->white[me - 1] = (g_board->white[me - 1] ^ Bit(from)) | Bit(to);
-  g_board->fifty        += 1; // Rule50 counter increased after non-decisive move
-
-  CheckNormalCapturesW(me, eat, to);
-  ModifyPawnStuffW(from, to);
-  AddMoveIfOkW();
-  g_board = g_board_orig; // Back to the old board
-}
-
-void AddNormalStuffB(const int from, const int to) {
-  const auto me  = g_board->pieces[from];
-  const auto eat = g_board->pieces[to];
-
-  g_moves[g_moves_n]      = *g_board;
-  g_board                 = &g_moves[g_moves_n];
-  g_board->from           = from;
-  g_board->to             = to;
-  g_board->score          = 0;
-  g_board->type           = 0;
-  g_board->epsq           = -1;
-  g_board->pieces[to]     = me;
-  g_board->pieces[from]   = 0;
-  g_board->black[-me - 1] = (g_board->black[-me - 1] ^ Bit(from)) | Bit(to);
-  g_board->fifty         += 1;
-
-  CheckNormalCapturesB(me, eat, to);
-  ModifyPawnStuffB(from, to);
-  AddMoveIfOkB();
-  g_board = g_board_orig;
-}
-
-void AddW(const int from, const int to) {
-  if (g_board->pieces[from] == +1 && MakeY(from) == 6)
-    AddPromotionStuffW(from, to);
-  else
-    AddNormalStuffW(from, to);
-}
-
-void AddB(const int from, const int to) {
-  if (g_board->pieces[from] == -1 && MakeY(from) == 1)
-    AddPromotionStuffB(from, to);
-  else
-    AddNormalStuffB(from, to);
-}
-
-void AddMovesW(const int from, std::uint64_t moves) {
-  while (moves) AddW(from, CtzrPop(&moves));
-}
-
-void AddMovesB(const int from, std::uint64_t moves) {
-  while (moves) AddB(from, CtzrPop(&moves));
-}
-
-void MgenPawnsW() {
-  for (auto p = g_board->white[0]; p; ) {
-    const auto sq = CtzrPop(&p);
-    AddMovesW(sq, g_pawn_checks_w[sq] & g_pawn_sq);
-    if (MakeY(sq) == 1) {
-      if (g_pawn_1_moves_w[sq] & g_empty)
-        AddMovesW(sq, g_pawn_2_moves_w[sq] & g_empty);
-    } else {
-      AddMovesW(sq, g_pawn_1_moves_w[sq] & g_empty);
-    }
-  }
-}
-
-void MgenPawnsB() {
-  for (auto p = g_board->black[0]; p; ) {
-    const auto sq = CtzrPop(&p);
-    AddMovesB(sq, g_pawn_checks_b[sq] & g_pawn_sq);
-    if (MakeY(sq) == 6) {
-      if (g_pawn_1_moves_b[sq] & g_empty)
-        AddMovesB(sq, g_pawn_2_moves_b[sq] & g_empty);
-    } else {
-      AddMovesB(sq, g_pawn_1_moves_b[sq] & g_empty);
-    }
-  }
-}
-
-void MgenPawnsOnlyCapturesW() {
-  for (auto p = g_board->white[0]; p; ) {
-    const auto sq = CtzrPop(&p);
-    AddMovesW(sq, MakeY(sq) == 6 ? g_pawn_1_moves_w[sq] & (~g_both) : g_pawn_checks_w[sq] & g_pawn_sq);
-  }
+void MgenPawnsOnlyCapturesW() {
+  for (auto p = g_board->white[0]; p; ) {
+    const auto sq = CtzrPop(&p);
+    AddMovesW(sq, MakeY(sq) == 6 ? g_pawn_1_moves_w[sq] & (~g_both) : g_pawn_checks_w[sq] & g_pawn_sq);
+  }
 }
 
 void MgenPawnsOnlyCapturesB() {
@@ -1678,6 +2017,72 @@ void MgenRooksPlusQueensB() {
   }
 }
 
+// Staged generation: Captures + promotions first, then the rest
+void MgenPawnsCapturesW() {
+  for (auto p = g_board->white[0]; p; ) {
+    const auto sq = CtzrPop(&p);
+    AddMovesW(sq, (g_pawn_checks_w[sq] & g_pawn_sq) | (MakeY(sq) == 6 ? g_pawn_1_moves_w[sq] & g_empty : 0));
+  }
+}
+
+void MgenPawnsCapturesB() {
+  for (auto p = g_board->black[0]; p; ) {
+    const auto sq = CtzrPop(&p);
+    AddMovesB(sq, (g_pawn_checks_b[sq] & g_pawn_sq) | (MakeY(sq) == 1 ? g_pawn_1_moves_b[sq] & g_empty : 0));
+  }
+}
+
+void MgenPawnsQuietsW() {
+  for (std::uint64_t p = g_board->white[0] & ~0x00FF000000000000ULL; p; ) { // No promotions
+    const auto sq = CtzrPop(&p);
+    if (MakeY(sq) == 1) {
+      if (g_pawn_1_moves_w[sq] & g_empty)
+        AddMovesW(sq, g_pawn_2_moves_w[sq] & g_empty);
+    } else {
+      AddMovesW(sq, g_pawn_1_moves_w[sq] & g_empty);
+    }
+  }
+}
+
+void MgenPawnsQuietsB() {
+  for (std::uint64_t p = g_board->black[0] & ~0x000000000000FF00ULL; p; ) {
+    const auto sq = CtzrPop(&p);
+    if (MakeY(sq) == 6) {
+      if (g_pawn_1_moves_b[sq] & g_empty)
+        AddMovesB(sq, g_pawn_2_moves_b[sq] & g_empty);
+    } else {
+      AddMovesB(sq, g_pawn_1_moves_b[sq] & g_empty);
+    }
+  }
+}
+
+// Pseudo targets of a single piece ( For the hash move + killers )
+std::uint64_t MgenTargetsW(const int sq) {
+  switch (g_board->pieces[sq]) {
+    case +1: return (g_pawn_checks_w[sq] & g_pawn_sq) | (g_pawn_1_moves_w[sq] & g_empty ?
+                      (MakeY(sq) == 1 ? g_pawn_2_moves_w[sq] : g_pawn_1_moves_w[sq]) & g_empty : 0);
+    case +2: return g_knight_moves[sq] & g_good;
+    case +3: return GetBishopMagicMoves(sq, g_both) & g_good;
+    case +4: return GetRookMagicMoves(sq, g_both) & g_good;
+    case +5: return (GetBishopMagicMoves(sq, g_both) | GetRookMagicMoves(sq, g_both)) & g_good;
+    case +6: return g_king_moves[sq] & g_good;
+    default: return 0;
+  }
+}
+
+std::uint64_t MgenTargetsB(const int sq) {
+  switch (g_board->pieces[sq]) {
+    case -1: return (g_pawn_checks_b[sq] & g_pawn_sq) | (g_pawn_1_moves_b[sq] & g_empty ?
+                      (MakeY(sq) == 6 ? g_pawn_2_moves_b[sq] : g_pawn_1_moves_b[sq]) & g_empty : 0);
+    case -2: return g_knight_moves[sq] & g_good;
+    case -3: return GetBishopMagicMoves(sq, g_both) & g_good;
+    case -4: return GetRookMagicMoves(sq, g_both) & g_good;
+    case -5: return (GetBishopMagicMoves(sq, g_both) | GetRookMagicMoves(sq, g_both)) & g_good;
+    case -6: return g_king_moves[sq] & g_good;
+    default: return 0;
+  }
+}
+
 void MgenKingW() {
   const auto sq = std::countr_zero(g_board->white[5]);
   AddMovesW(sq, g_king_moves[sq] & g_good);
@@ -1695,19 +2100,75 @@ void MgenSetupBoth() {
   g_empty = ~g_both;
 }
 
+// Checkers + Pinned pieces + Evasion squares. Once per node
+void MgenPinsW() {
+  g_king_sq  = std::countr_zero(g_board->white[5]);
+  g_checkers = (g_pawn_checks_w[g_king_sq]              &  g_board->black[0]) |
+               (g_knight_moves[g_king_sq]               &  g_board->black[1]) |
+               (GetBishopMagicMoves(g_king_sq, g_both)  & (g_board->black[2] | g_board->black[4])) |
+               (GetRookMagicMoves(g_king_sq, g_both)    & (g_board->black[3] | g_board->black[4]));
+  g_pinned   = 0;
+  for (auto snipers = (GetBishopMagicMoves(g_king_sq, 0) & (g_board->black[2] | g_board->black[4])) |
+                      (GetRookMagicMoves(g_king_sq, 0)   & (g_board->black[3] | g_board->black[4])); snipers; )
+    if (const auto blockers = g_between[g_king_sq][CtzrPop(&snipers)] & g_both; std::has_single_bit(blockers))
+      g_pinned |= blockers & g_white;
+  g_check_mask = !g_checkers ? ~0ULL :
+    (std::has_single_bit(g_checkers) ? g_between[g_king_sq][std::countr_zero(g_checkers)] | g_checkers : 0);
+}
+
+void MgenPinsB() {
+  g_king_sq  = std::countr_zero(g_board->black[5]);
+  g_checkers = (g_pawn_checks_b[g_king_sq]              &  g_board->white[0]) |
+               (g_knight_moves[g_king_sq]               &  g_board->white[1]) |
+               (GetBishopMagicMoves(g_king_sq, g_both)  & (g_board->white[2] | g_board->white[4])) |
+               (GetRookMagicMoves(g_king_sq, g_both)    & (g_board->white[3] | g_board->white[4]));
+  g_pinned   = 0;
+  for (auto snipers = (GetBishopMagicMoves(g_king_sq, 0) & (g_board->white[2] | g_board->white[4])) |
+                      (GetRookMagicMoves(g_king_sq, 0)   & (g_board->white[3] | g_board->white[4])); snipers; )
+    if (const auto blockers = g_between[g_king_sq][CtzrPop(&snipers)] & g_both; std::has_single_bit(blockers))
+      g_pinned |= blockers & g_black;
+  g_check_mask = !g_checkers ? ~0ULL :
+    (std::has_single_bit(g_checkers) ? g_between[g_king_sq][std::countr_zero(g_checkers)] | g_checkers : 0);
+}
+
 void MgenSetupW() {
   MgenSetupBoth();
   g_pawn_sq = g_black | (g_board->epsq > 0 ? Bit(g_board->epsq) & 0x0000FF0000000000ULL : 0);
+  MgenPinsW();
 }
 
 void MgenSetupB() {
   MgenSetupBoth();
   g_pawn_sq = g_white | (g_board->epsq > 0 ? Bit(g_board->epsq) & 0x0000000000FF0000ULL : 0);
+  MgenPinsB();
+}
+
+// Double check -> Only king moves. Otherwise capture or block the checker
+void MgenEvasionsW() {
+  MgenKingW();
+  if (!g_check_mask) return;
+  MgenPawnsW();
+  MgenKnightsW();
+  MgenBishopsPlusQueensW();
+  MgenRooksPlusQueensW();
+}
+
+void MgenEvasionsB() {
+  MgenKingB();
+  if (!g_check_mask) return;
+  MgenPawnsB();
+  MgenKnightsB();
+  MgenBishopsPlusQueensB();
+  MgenRooksPlusQueensB();
 }
 
 void MgenAllW() {
   MgenSetupW();
   g_good = ~g_white;
+  if (g_checkers) {
+    MgenEvasionsW();
+    return;
+  }
   MgenPawnsW();
   MgenKnightsW();
   MgenBishopsPlusQueensW();
@@ -1719,6 +2180,10 @@ void MgenAllW() {
 void MgenAllB() {
   MgenSetupB();
   g_good = ~g_black;
+  if (g_checkers) {
+    MgenEvasionsB();
+    return;
+  }
   MgenPawnsB();
   MgenKnightsB();
   MgenBishopsPlusQueensB();
@@ -1747,50 +2212,504 @@ void MgenAllCapturesB() {
   MgenKingB();
 }
 
-void MgenReset(Board *moves) {
-  g_moves_n    = 0;
-  g_moves      = moves;
-  g_board_orig = g_board;
+void MgenCapturesStageW() {
+  MgenSetupW();
+  g_good = g_black;
+  MgenPawnsCapturesW();
+  MgenKnightsW();
+  MgenBishopsPlusQueensW();
+  MgenRooksPlusQueensW();
+  MgenKingW();
+}
+
+void MgenCapturesStageB() {
+  MgenSetupB();
+  g_good = g_white;
+  MgenPawnsCapturesB();
+  MgenKnightsB();
+  MgenBishopsPlusQueensB();
+  MgenRooksPlusQueensB();
+  MgenKingB();
+}
+
+void MgenQuietsStageW() {
+  MgenSetupW();
+  g_good = g_empty;
+  MgenPawnsQuietsW();
+  MgenKnightsW();
+  MgenBishopsPlusQueensW();
+  MgenRooksPlusQueensW();
+  MgenKingW();
+  MgenCastlingMovesW();
+}
+
+void MgenQuietsStageB() {
+  MgenSetupB();
+  g_good = g_empty;
+  MgenPawnsQuietsB();
+  MgenKnightsB();
+  MgenBishopsPlusQueensB();
+  MgenRooksPlusQueensB();
+  MgenKingB();
+  MgenCastlingMovesB();
+}
+
+// Generate only the given move ( if legal )
+void MgenMoveW(const std::uint16_t move) {
+  MgenSetupW();
+  g_good = ~g_white;
+  switch (MoveType(move)) {
+    case 1:  AddOOW(); break;
+    case 2:  AddOOOW(); break;
+    case 3: case 4: break;
+    default: AddMovesW(MoveFrom(move), MgenTargetsW(MoveFrom(move)) & Bit(MoveTo(move))); break;
+  }
+}
+
+void MgenMoveB(const std::uint16_t move) {
+  MgenSetupB();
+  g_good = ~g_black;
+  switch (MoveType(move)) {
+    case 3:  AddOOB(); break;
+    case 4:  AddOOOB(); break;
+    case 1: case 2: break;
+    default: AddMovesB(MoveFrom(move), MgenTargetsB(MoveFrom(move)) & Bit(MoveTo(move))); break;
+  }
+}
+
+// Moves of g_board -> Move list of the ply
+void MgenReset(const int ply) {
+  g_moves_n = 0;
+  g_moves   = g_move_list[ply];
+  g_scores  = g_move_scores[ply];
 }
 
 // Generate everything
-int MgenW(Board *moves) {
-  MgenReset(moves);
+int MgenW(const int ply) {
+  MgenReset(ply);
   MgenAllW();
   return g_moves_n;
 }
 
-int MgenB(Board *moves) {
-  MgenReset(moves);
+int MgenB(const int ply) {
+  MgenReset(ply);
   MgenAllB();
   return g_moves_n;
 }
 
 // Generate only captures
-int MgenCapturesW(Board *moves) {
-  MgenReset(moves);
+int MgenCapturesW(const int ply) {
+  MgenReset(ply);
   MgenAllCapturesW();
   return g_moves_n;
 }
 
-int MgenCapturesB(Board *moves) {
-  MgenReset(moves);
+int MgenCapturesB(const int ply) {
+  MgenReset(ply);
   MgenAllCapturesB();
   return g_moves_n;
 }
 
-// All moves if under checks or just captures
-int MgenTacticalW(Board *moves) {
-  return ChecksB() ? MgenW(moves) : MgenCapturesW(moves);
+// Generate only root moves
+void MgenRoot() {
+  g_root_n = g_wtm ? MgenW(0) : MgenB(0);
 }
 
-int MgenTacticalB(Board *moves) {
-  return ChecksW() ? MgenB(moves) : MgenCapturesB(moves);
+// Make move ( Copy-on-make: 1 board per ply )
+
+void HandleCastlingRights() {
+  if (!g_board->castle) return;
+  if (g_board->pieces[g_king_w] != +6)    g_board->castle &= 0x4 | 0x8;
+  if (g_board->pieces[g_rook_w[0]] != +4) g_board->castle &= 0x2 | 0x4 | 0x8;
+  if (g_board->pieces[g_rook_w[1]] != +4) g_board->castle &= 0x1 | 0x4 | 0x8;
+  if (g_board->pieces[g_king_b] != -6)    g_board->castle &= 0x1 | 0x2;
+  if (g_board->pieces[g_rook_b[0]] != -4) g_board->castle &= 0x1 | 0x2 | 0x8;
+  if (g_board->pieces[g_rook_b[1]] != -4) g_board->castle &= 0x1 | 0x2 | 0x4;
 }
 
-// Generate only root moves
-void MgenRoot() {
-  g_root_n = g_wtm ? MgenW(g_boards[0]) : MgenB(g_boards[0]);
+void MakeCastleW(const int rook, const int king_to, const int rook_to) {
+  g_board->castle             &= 0x4 | 0x8;
+  g_board->fifty               = 0;
+  g_board->pieces[rook]        = 0;
+  g_board->pieces[g_king_w]    = 0;
+  g_board->pieces[rook_to]     = +4;
+  g_board->pieces[king_to]     = +6;
+  g_board->white[3]            = (g_board->white[3] ^ Bit(rook))     | Bit(rook_to);
+  g_board->white[5]            = (g_board->white[5] ^ Bit(g_king_w)) | Bit(king_to);
+  HashPiece(+4, rook);
+  HashPiece(+6, g_king_w);
+  HashPiece(+4, rook_to);
+  HashPiece(+6, king_to);
+}
+
+void MakeCastleB(const int rook, const int king_to, const int rook_to) {
+  g_board->castle             &= 0x1 | 0x2;
+  g_board->fifty               = 0;
+  g_board->pieces[rook]        = 0;
+  g_board->pieces[g_king_b]    = 0;
+  g_board->pieces[rook_to]     = -4;
+  g_board->pieces[king_to]     = -6;
+  g_board->black[3]            = (g_board->black[3] ^ Bit(rook))     | Bit(rook_to);
+  g_board->black[5]            = (g_board->black[5] ^ Bit(g_king_b)) | Bit(king_to);
+  HashPiece(-4, rook);
+  HashPiece(-6, g_king_b);
+  HashPiece(-4, rook_to);
+  HashPiece(-6, king_to);
+}
+
+void MakePromotionW(const int from, const int to, const int piece) {
+  const auto eat = g_board->pieces[to];
+
+  g_board->fifty             = 0;
+  g_board->pieces[to]        = piece;
+  g_board->pieces[from]      = 0;
+  g_board->white[0]         ^= Bit(from);
+  g_board->white[piece - 1] |= Bit(to);
+  HashPiece(+1, from);
+  HashPiece(piece, to);
+
+  if (eat <= -1) {
+    g_board->black[-eat - 1] ^= Bit(to);
+    HashPiece(eat, to);
+  }
+  HandleCastlingRights();
+}
+
+void MakePromotionB(const int from, const int to, const int piece) {
+  const auto eat = g_board->pieces[to];
+
+  g_board->fifty              = 0;
+  g_board->pieces[to]         = piece;
+  g_board->pieces[from]       = 0;
+  g_board->black[0]          ^= Bit(from);
+  g_board->black[-piece - 1] |= Bit(to);
+  HashPiece(-1, from);
+  HashPiece(piece, to);
+
+  if (eat >= +1) {
+    g_board->white[eat - 1] ^= Bit(to);
+    HashPiece(eat, to);
+  }
+  HandleCastlingRights();
+}
+
+void ModifyPawnStuffW(const int from, const int to) {
+  if (g_board->pieces[to] != +1) return;
+
+  g_board->fifty = 0;
+  if (to == g_board_orig->epsq) {
+    g_board->pieces[to - 8] = 0;
+    g_board->black[0]      ^= Bit(to - 8);
+    HashPiece(-1, to - 8);
+  } else if (MakeY(from) == 1 && MakeY(to) == 3) { // e2e4 ...
+    g_board->epsq = to - 8;
+  }
+}
+
+void ModifyPawnStuffB(const int from, const int to) {
+  if (g_board->pieces[to] != -1) return;
+
+  g_board->fifty = 0;
+  if (to == g_board_orig->epsq) {
+    g_board->pieces[to + 8] = 0;
+    g_board->white[0]      ^= Bit(to + 8);
+    HashPiece(+1, to + 8);
+  } else if (MakeY(from) == 6 && MakeY(to) == 4) {
+    g_board->epsq = to + 8;
+  }
+}
+
+void MakeNormalW(const int from, const int to) {
+  const auto me  = g_board->pieces[from];
+  const auto eat = g_board->pieces[to];
+
+  g_board->pieces[from]  = 0;
+  g_board->pieces[to]    = me;
+  g_board->white[me - 1] = (g_board->white[me - 1] ^ Bit(from)) | Bit(to);
+  g_board->fifty        += 1; // Rule50 counter increased after non-decisive move
+  HashPiece(me, from);
+  HashPiece(me, to);
+
+  if (eat <= -1) {
+    g_board->black[-eat - 1] ^= Bit(to);
+    g_board->fifty            = 0;
+    HashPiece(eat, to);
+  }
+  ModifyPawnStuffW(from, to);
+  HandleCastlingRights();
+}
+
+void MakeNormalB(const int from, const int to) {
+  const auto me  = g_board->pieces[from];
+  const auto eat = g_board->pieces[to];
+
+  g_board->pieces[from]   = 0;
+  g_board->pieces[to]     = me;
+  g_board->black[-me - 1] = (g_board->black[-me - 1] ^ Bit(from)) | Bit(to);
+  g_board->fifty         += 1;
+  HashPiece(me, from);
+  HashPiece(me, to);
+
+  if (eat >= +1) {
+    g_board->white[eat - 1] ^= Bit(to);
+    g_board->fifty           = 0;
+    HashPiece(eat, to);
+  }
+  ModifyPawnStuffB(from, to);
+  HandleCastlingRights();
+}
+
+// Parent -> g_boards[ply] -> g_board. Legal move expected
+void MakeMoveW(Board *parent, const int ply, const std::uint16_t move) {
+  g_boards[ply] = *parent; // Copy board
+  g_board_orig  = parent;
+  g_board       = g_boards + ply; // Set pointer
+  g_accumulators[ply + 1].computedAccumulation = false; // NNUE: Update from the parent when needed
+  g_accumulator_parents[ply] = parent;
+  g_board->from = MoveFrom(move);
+  g_board->to   = MoveTo(move);
+  g_board->type = MoveType(move);
+  g_board->epsq = -1;
+  switch (g_board->type) {
+    case 1:  MakeCastleW(g_rook_w[0], 6, 5); break; // O-O
+    case 2:  MakeCastleW(g_rook_w[1], 2, 3); break; // O-O-O
+    case 5: case 6: case 7: case 8: MakePromotionW(g_board->from, g_board->to, g_board->type - 3); break;
+    default: MakeNormalW(g_board->from, g_board->to); break;
+  }
+  HashSpecial();
+}
+
+void MakeMoveB(Board *parent, const int ply, const std::uint16_t move) {
+  g_boards[ply] = *parent;
+  g_board_orig  = parent;
+  g_board       = g_boards + ply;
+  g_accumulators[ply + 1].computedAccumulation = false;
+  g_accumulator_parents[ply] = parent;
+  g_board->from = MoveFrom(move);
+  g_board->to   = MoveTo(move);
+  g_board->type = MoveType(move);
+  g_board->epsq = -1;
+  switch (g_board->type) {
+    case 3:  MakeCastleB(g_rook_b[0], 56 + 6, 56 + 5); break;
+    case 4:  MakeCastleB(g_rook_b[1], 56 + 2, 56 + 3); break;
+    case 5: case 6: case 7: case 8: MakePromotionB(g_board->from, g_board->to, -(g_board->type - 3)); break;
+    default: MakeNormalB(g_board->from, g_board->to); break;
+  }
+  HashSpecial();
+}
+
+void MakeMove(const bool wtm, Board *parent, const int ply, const std::uint16_t move) {
+  if (wtm) MakeMoveW(parent, ply, move); else MakeMoveB(parent, ply, move);
+}
+
+// Pass: Same board w/ the other side to move. A child like any other ( Own ply, stack and accumulator )
+void MakeNullMove(Board *parent, const int ply) {
+  g_boards[ply] = *parent;
+  g_board_orig  = parent;
+  g_board       = g_boards + ply;
+  g_accumulators[ply + 1].computedAccumulation = false;
+  g_accumulator_parents[ply] = parent;
+  g_board->from  = g_board->to = 0;
+  g_board->type  = 9;
+  g_board->epsq  = -1;
+  g_board->hash ^= g_zobrist_wtm[0] ^ g_zobrist_wtm[1] ^ g_zobrist_ep[parent->epsq + 1] ^ g_zobrist_ep[0];
+}
+
+// History
+
+// Continuation history of the move made n plies ago ( Root / Null move -> None )
+std::int16_t (*ContHistory(const int ply, const int n))[64] {
+  if (ply - n < 0) return nullptr;
+  const auto *board = g_boards + ply - n;
+  return board->is_nullmove() ? nullptr : g_cont_history[board->pieces[board->to] + 6][board->to];
+}
+
+// Reply that refuted the last move before ( Null move -> None )
+std::uint16_t CounterMove(const int ply) {
+  if (ply < 1) return 0;
+  const auto *board = g_boards + ply - 1;
+  return board->is_nullmove() ? 0 : g_countermoves[board->pieces[board->to] + 6][board->to];
+}
+
+// Butterfly + 1 and 2 ply continuation history
+int QuietScore(const Board *parent, const bool wtm, const int ply, const std::uint16_t move) {
+  const auto from = MoveFrom(move), to = MoveTo(move), piece = parent->pieces[from] + 6;
+  auto score = static_cast<int>(g_history[wtm][from][to]);
+  for (const auto n : {1, 2})
+    if (const auto *cont = ContHistory(ply, n)) score += cont[piece][to];
+  return score;
+}
+
+// Gravity: The closer to the limit the smaller the step -> Stays in [-HISTORY_MAX, +HISTORY_MAX]
+void UpdateHistory(std::int16_t *entry, const int bonus) {
+  *entry += bonus - *entry * std::abs(bonus) / HISTORY_MAX;
+}
+
+void UpdateQuietHistory(const Board *parent, const bool wtm, const int ply, const std::uint16_t move, const int bonus) {
+  const auto from = MoveFrom(move), to = MoveTo(move), piece = parent->pieces[from] + 6;
+  UpdateHistory(&g_history[wtm][from][to], bonus);
+  for (const auto n : {1, 2})
+    if (auto *cont = ContHistory(ply, n)) UpdateHistory(&cont[piece][to], bonus);
+}
+
+// struct MovePicker
+
+// Castling / Non-capturing non-promotion
+bool MovePicker::is_quiet(const std::uint16_t move) const {
+  const auto from = MoveFrom(move), to = MoveTo(move), type = MoveType(move);
+  return (type >= 1 && type <= 4) ||
+         (type == 0 && !this->parent->pieces[to] &&
+          !(std::abs(this->parent->pieces[from]) == 1 && to == this->parent->epsq));
+}
+
+// =q / Equal or better victim / Undefended victim
+bool MovePicker::is_good_capture(const std::uint16_t move) const {
+  g_board = this->parent;
+  return IsGoodCapture(this->wtm, move);
+}
+
+// History decides the order of quiets. Countermove gets a boost
+void MovePicker::score_quiets(const int start) {
+  for (auto j = start; j < this->n; j += 1) {
+    const auto move = g_move_list[this->ply][j];
+    g_move_scores[this->ply][j] += (move == this->counter_move ? COUNTERMOVE_BONUS : 0) +
+                                   QuietScore(this->parent, this->wtm, this->ply, move);
+  }
+}
+
+// Append to the move list of this ply
+void MovePicker::mgen_setup() const {
+  g_board   = this->parent;
+  g_moves   = g_move_list[this->ply];
+  g_scores  = g_move_scores[this->ply];
+  g_moves_n = this->n;
+}
+
+bool MovePicker::add_move(const std::uint16_t move) {
+  this->mgen_setup();
+  if (this->wtm) MgenMoveW(move); else MgenMoveB(move);
+  // Promotions generate many moves -> Keep only the right one
+  for (auto j = this->n; j < g_moves_n; j += 1)
+    if (g_moves[j] == move) {
+      g_moves[this->n]  = g_moves[j];
+      g_scores[this->n] = g_scores[j];
+      this->n          += 1;
+      return true;
+    }
+  return false;
+}
+
+// Already searched in an earlier stage
+void MovePicker::remove_move(const int start, const std::uint16_t move) {
+  if (!move) return;
+  for (auto j = start; j < this->n; j += 1)
+    if (g_move_list[this->ply][j] == move) {
+      this->n                       -= 1;
+      g_move_list[this->ply][j]      = g_move_list[this->ply][this->n];
+      g_move_scores[this->ply][j]    = g_move_scores[this->ply][this->n];
+      return;
+    }
+}
+
+// Everything at once. Hash move first
+void MovePicker::evasions() {
+  g_board     = this->parent;
+  this->n     = this->wtm ? MgenW(this->ply) : MgenB(this->ply);
+  this->stage = Stage::kEvasions;
+  for (auto j = 0; this->hash_move && j < this->n; j += 1)
+    if (g_move_list[this->ply][j] == this->hash_move) {
+      g_move_scores[this->ply][j] += 10000;
+      break;
+    }
+}
+
+std::uint16_t MovePicker::yield() {
+  this->score = g_move_scores[this->ply][this->i];
+  return g_move_list[this->ply][this->i++];
+}
+
+// Best of the rest. Stop sorting only when the rest score all the same
+// ( Negative history quiets must stay last: LMR / LMP go by the move index )
+std::uint16_t MovePicker::pick(const int end) {
+  if (this->sort) {
+    auto *scores = g_move_scores[this->ply];
+    auto lowest  = scores[this->i];
+    for (auto j = this->i + 1; j < end; j += 1) {
+      lowest = std::min(lowest, scores[j]);
+      if (scores[j] > scores[this->i]) {
+        std::swap(scores[this->i], scores[j]);
+        std::swap(g_move_list[this->ply][this->i], g_move_list[this->ply][j]);
+      }
+    }
+    this->sort = lowest != scores[this->i];
+  }
+  return this->yield();
+}
+
+// 0 -> No more moves
+std::uint16_t MovePicker::next() {
+  switch (this->stage) {
+    case Stage::kHash:
+      this->stage = Stage::kGenCaptures;
+      if (this->hash_move && this->add_move(this->hash_move)) return this->yield();
+      [[fallthrough]];
+    case Stage::kGenCaptures:
+      this->mgen_setup();
+      if (this->wtm) MgenCapturesStageW(); else MgenCapturesStageB();
+      this->n = g_moves_n;
+      this->remove_move(this->i, this->hash_move);
+      // Losing captures last
+      for (auto j = this->i; j < this->n; j += 1)
+        if (!this->is_good_capture(g_move_list[this->ply][j])) g_move_scores[this->ply][j] -= 1000;
+      this->stage = Stage::kGoodCaptures;
+      [[fallthrough]];
+    case Stage::kGoodCaptures:
+      if (this->i < this->n) {
+        LazySort(this->ply, this->i, this->n);
+        if (g_move_scores[this->ply][this->i] >= 0) return this->yield();
+      }
+      this->bad   = this->i;
+      this->bad_n = this->n;
+      this->i     = this->n;
+      this->stage = Stage::kKillers;
+      [[fallthrough]];
+    case Stage::kKillers:
+      while (this->killer_i < 2) {
+        const auto killer = this->killers[this->killer_i++];
+        if (!killer || killer == this->hash_move || !this->add_move(killer)) continue;
+        if (this->is_quiet(killer)) return this->yield();
+        this->n -= 1; // Capture here -> Already searched
+      }
+      this->stage = Stage::kGenQuiets;
+      [[fallthrough]];
+    case Stage::kGenQuiets: {
+      const auto start = this->n;
+      this->mgen_setup();
+      if (this->wtm) MgenQuietsStageW(); else MgenQuietsStageB();
+      this->n = g_moves_n;
+      this->remove_move(start, this->hash_move);
+      this->remove_move(start, this->killers[0]);
+      this->remove_move(start, this->killers[1]);
+      this->score_quiets(start);
+      this->i     = start;
+      this->stage = Stage::kQuiets;
+      [[fallthrough]];
+    }
+    case Stage::kQuiets:
+      if (this->i < this->n) return this->pick(this->n);
+      this->i     = this->bad;
+      this->sort  = true;
+      this->stage = Stage::kBadCaptures;
+      [[fallthrough]];
+    case Stage::kBadCaptures:
+      if (this->i < this->bad_n) return this->pick(this->bad_n);
+      this->stage = Stage::kDone;
+      return 0;
+    case Stage::kEvasions:
+      return this->i < this->n ? this->pick(this->n) : 0;
+    default:
+      return 0;
+  }
 }
 
 // Evaluation
@@ -2128,34 +3047,100 @@ int Evaluation::evaluate() {
              ->calculate_score();
 }
 
-// struct NnueEval
+// NNUE accumulators
 
-int NnueEval::probe() const {
+// PNBRQK -> 6 5 4 3 2 1 / pnbrqk -> 12 11 10 9 8 7
+int NnuePiece(const int piece) {
+  return piece > 0 ? 7 - piece : 13 + piece;
+}
+
+// Kings first, then the rest. 0 terminated
+void NnuePieceList(const Board *board) {
   std::size_t i = 2;
-  for (auto both = Both(); both ; )
-    switch (const auto sq = CtzrPop(&both); g_board->pieces[sq]) {
-      case +1: case +2: case +3: case +4: case +5: // PNBRQ
-        g_nnue_pieces[i]    = 7 - g_board->pieces[sq];
-        g_nnue_squares[i++] = sq;
-        break;
-      case -1: case -2: case -3: case -4: case -5: // pnbrq
-        g_nnue_pieces[i]    = 13 + g_board->pieces[sq];
-        g_nnue_squares[i++] = sq;
-        break;
-      case +6: // K
-        g_nnue_pieces[0]  = 1;
-        g_nnue_squares[0] = sq;
-        break;
-      case -6: // k
-        g_nnue_pieces[1]  = 7;
-        g_nnue_squares[1] = sq;
-        break;
+  for (auto both = board->white[0] | board->white[1] | board->white[2] | board->white[3] | board->white[4] |
+                   board->black[0] | board->black[1] | board->black[2] | board->black[3] | board->black[4]; both; ) {
+    const auto sq       = CtzrPop(&both);
+    g_nnue_pieces[i]    = NnuePiece(board->pieces[sq]);
+    g_nnue_squares[i++] = sq;
+  }
+  g_nnue_pieces[0]  = 1;
+  g_nnue_squares[0] = std::countr_zero(board->white[5]);
+  g_nnue_pieces[1]  = 7;
+  g_nnue_squares[1] = std::countr_zero(board->black[5]);
+  g_nnue_pieces[i]  = g_nnue_squares[i] = 0;
+}
+
+// Stack slot of a board ( -1 -> Not on the stack )
+int AccumulatorIndex(const Board *board) {
+  if (board == &g_board_empty) return 0;
+  return board >= g_boards && board < g_boards + MAX_SEARCH_DEPTH + MAX_Q_SEARCH_DEPTH ?
+    static_cast<int>(board - g_boards) + 1 : -1;
+}
+
+const Board* AccumulatorBoard(const int i) {
+  return i ? g_boards + i - 1 : &g_board_empty;
+}
+
+// Diff 8 squares at a time. Kings aren't features: Moved king -> Refresh that side
+void NnueDirtyPieces(const Board *parent, const Board *board, nnue::DirtyPieces *dirty) {
+  dirty->king_squares[0] = std::countr_zero(board->white[5]);
+  dirty->king_squares[1] = std::countr_zero(board->black[5]);
+  dirty->king_moved[0]   = parent->white[5] != board->white[5];
+  dirty->king_moved[1]   = parent->black[5] != board->black[5];
+  dirty->n_removed       = dirty->n_added = 0;
+  for (auto sq8 = 0; sq8 < 64; sq8 += 8) {
+    std::uint64_t before = 0, after = 0;
+    std::memcpy(&before, parent->pieces + sq8, 8);
+    std::memcpy(&after,  board->pieces  + sq8, 8);
+    for (auto sq = sq8; before != after && sq < sq8 + 8; sq += 1) {
+      const int p = parent->pieces[sq], b = board->pieces[sq];
+      if (p == b) continue;
+      if (p && std::abs(p) != 6) {
+        dirty->removed_pieces[dirty->n_removed]    = NnuePiece(p);
+        dirty->removed_squares[dirty->n_removed++] = sq;
+      }
+      if (b && std::abs(b) != 6) {
+        dirty->added_pieces[dirty->n_added]    = NnuePiece(b);
+        dirty->added_squares[dirty->n_added++] = sq;
+      }
     }
+  }
+}
+
+// Walk back to the nearest computed accumulator, then update forward ply by ply
+nnue::Accumulator* ComputeAccumulator(const Board *board) {
+  const auto i = AccumulatorIndex(board);
+  if (i < 0) return nullptr;
+  auto j = i;
+  while (j && !g_accumulators[j].computedAccumulation && AccumulatorIndex(g_accumulator_parents[j - 1]) == j - 1)
+    j -= 1;
+  if (!g_accumulators[j].computedAccumulation || (!j && g_accumulator_root != g_board_empty.hash)) { // From scratch
+    NnuePieceList(AccumulatorBoard(j));
+    nnue::nnue_refresh_accumulator(g_nnue_nets[g_nnue_net], g_accumulators + j, g_nnue_pieces, g_nnue_squares);
+    if (!j) g_accumulator_root = g_board_empty.hash;
+  }
+  for (auto k = j + 1; k <= i; k += 1) {
+    nnue::DirtyPieces dirty{};
+    NnueDirtyPieces(AccumulatorBoard(k - 1), AccumulatorBoard(k), &dirty);
+    if (dirty.king_moved[0] || dirty.king_moved[1]) NnuePieceList(AccumulatorBoard(k));
+    nnue::nnue_update_accumulator(g_nnue_nets[g_nnue_net], g_accumulators + k, g_accumulators + k - 1, &dirty, g_nnue_pieces, g_nnue_squares);
+  }
+  return g_accumulators + i;
+}
 
-  g_nnue_pieces[i] = g_nnue_squares[i] = 0;
+// struct NnueEval
 
-  return this->wtm ? +(nnue::nnue_evaluate(0, g_nnue_pieces, g_nnue_squares) + TEMPO_BONUS) :
-                     -(nnue::nnue_evaluate(1, g_nnue_pieces, g_nnue_squares) + TEMPO_BONUS);
+// Incremental on the search stack. Elsewhere from scratch
+int NnueEval::probe() const {
+  const auto player = this->wtm ? 0 : 1;
+  int eval = 0;
+  if (auto *accumulator = ComputeAccumulator(g_board)) {
+    eval = nnue::nnue_evaluate_accumulator(g_nnue_nets[g_nnue_net], player, accumulator);
+  } else {
+    NnuePieceList(g_board);
+    eval = nnue::nnue_evaluate(g_nnue_nets[g_nnue_net], player, g_nnue_pieces, g_nnue_squares);
+  }
+  return this->wtm ? +(eval + TEMPO_BONUS) : -(eval + TEMPO_BONUS);
 }
 
 int NnueEval::evaluate() {
@@ -2181,24 +3166,48 @@ float GetScale() {
     1.0f - ((static_cast<float>(g_board->fifty - SHUFFLE)) / static_cast<float>(FIFTY + 10.0f)), 0.0f, 1.0f);
 }
 
+// Multiply-high like the hashtable. Low 48 bits verify the slot
+std::atomic<std::uint64_t>* GetEvalSlot(const std::uint64_t key) {
+  return &g_eval_hash[static_cast<std::uint64_t>((static_cast<uint128_t>(key) * g_eval_hash_n) >> 64)];
+}
+
+// Cached by position. Keys differ by the eval side ( Root moves are evaluated by the mover ) and HCE / NNUE net
 int GetEval(const bool wtm) {
-  return FixFRC() + (g_classical ? EvaluateClassical(wtm) : EvaluateNNUE(wtm));
+  const auto key   = g_board->hash ^ (wtm ? 0 : 0xC2B2AE3D27D4EB4FULL) ^
+                     (g_classical ? 0 : 0x9E3779B97F4A7C15ULL * (1 + g_nnue_net));
+  auto *slot       = GetEvalSlot(key);
+  const auto entry = slot->load(std::memory_order_relaxed);
+  const auto hit   = (entry >> 16) == (key & 0xFFFFFFFFFFFFULL);
+  g_nodes[g_thread_id].add_eval(hit);
+  if (hit) return static_cast<std::int16_t>(entry & 0xFFFF);
+
+  const auto eval = FixFRC() + (g_classical ? EvaluateClassical(wtm) : EvaluateNNUE(wtm));
+  if (eval == static_cast<std::int16_t>(eval)) // Fits -> Cache
+    slot->store((key << 16) | static_cast<std::uint16_t>(eval), std::memory_order_relaxed);
+  return eval;
+}
+
+// Noise + Rule 50 scale on top of the raw eval. Never cached: They change w/ the level and the fifty counter
+int ScaleEval(const bool wtm, const int eval) {
+  return LevelNoise() + (IsEasyDraw(wtm) ? 0 : (GetScale() * static_cast<float>(eval)));
 }
 
 int Evaluate(const bool wtm) {
-  return LevelNoise() + (IsEasyDraw(wtm) ? 0 : (GetScale() * static_cast<float>(GetEval(wtm))));
+  return ScaleEval(wtm, GetEval(wtm));
 }
 
 // Search
 
-void SpeakUci(const int score, const std::uint64_t ms) {
+// Bound: Aspiration window failed ( Side to move POV )
+void SpeakUci(const int score, const std::uint64_t ms, const Bound bound = Bound::kExact) {
   std::cout <<
     "info depth " << std::min(g_max_depth, g_depth + 1) <<
-    " nodes " << g_nodes <<
+    " nodes " << Nodes() <<
     " time " << ms <<
-    " nps " << Nps(g_nodes, ms) <<
+    " nps " << Nps(Nodes(), ms) <<
     " score cp " << ((g_wtm ? +1 : -1) * (std::abs(score) == INF ? score / 100 : score)) <<
-    " pv " << g_boards[0][0].movename() << std::endl; // flush
+    (bound == Bound::kLower ? " lowerbound" : bound == Bound::kUpper ? " upperbound" : "") <<
+    " pv " << MoveName(g_move_list[0][0]) << std::endl; // flush
 }
 
 bool Draw(const bool wtm) {
@@ -2227,51 +3236,168 @@ bool UserStop() {
   return Token("quit") ? !(g_game_on = false) : Token("stop");
 }
 
+// Only the main thread reads the clock and std::cin
 bool CheckTime() {
   static std::uint64_t ticks = 0;
-  return ((++ticks) & READ_CLOCK) ? false : ((g_stop_search_time < Now()) || UserStop());
+  if (g_thread_id || ((++ticks) & READ_CLOCK)) return false;
+  return (g_stop_search = (g_stop_search_time < Now()) || UserStop());
+}
+
+// Most material a capture can win ( Victim + Promotion )
+int DeltaValue(const std::uint16_t move) {
+  const auto eat = std::abs(g_board->pieces[MoveTo(move)]);
+  return (eat ? kPestoMaterial[0][eat - 1] : kPestoMaterial[0][0]) + // En passant
+         (MoveType(move) == 8 ? kPestoMaterial[0][4] - kPestoMaterial[0][0] : 0);
+}
+
+// Answer checks w/ all evasions only near the horizon. Deeper -> Captures only
+bool QChecksW(const int depth) {
+  return g_q_depth - depth < Q_CHECK_PLIES && ChecksB();
+}
+
+bool QChecksB(const int depth) {
+  return g_q_depth - depth < Q_CHECK_PLIES && ChecksW();
+}
+
+// Only positions w/o a main search result go here ( Deeper entries stay )
+void QStore(const std::uint64_t hash, const HashEntry &entry, const int score, const int eval,
+    const Bound bound, const std::uint16_t move) {
+  if (!g_stop_search && (!entry.is_ok(hash) || !entry.depth))
+    GetHashBucket(hash)->store(hash, score, eval, 0, bound, move);
 }
 
-// 1. Check against standpat to see whether we are better -> Done
-// 2. Iterate deeper
+// 1. Probe the hashtable. Any depth will do
+// 2. Check against standpat to see whether we are better -> Done
+// 3. Iterate deeper. Skip losing captures and those that can't reach alpha ( Delta )
 int QSearchW(int alpha, const int beta, const int depth, const int ply) {
-  g_nodes += 1; // Increase visited nodes count
+  g_nodes[g_thread_id].add(); // Increase visited nodes count
 
   // Search is stopped. Return ASAP
-  if (g_stop_search || (g_stop_search = CheckTime())) return 0;
+  if (g_stop_search || CheckTime()) return 0;
 
-  // Better / terminal node -> Done
-  if (((alpha = std::max(alpha, Evaluate(true))) >= beta) || depth <= 0) return alpha;
+  const auto hash  = g_board->hash;
+  const auto entry = GetHashBucket(hash)->find(hash);
+  if (entry.cutoff(hash, alpha, beta, 0)) return entry.score;
+  auto raw_eval = entry.static_eval(hash);
+  if (raw_eval == NO_EVAL) raw_eval = GetEval(true);
+  const auto eval = ScaleEval(true, raw_eval);
 
-  const auto moves_n = MgenTacticalW(g_boards[ply]);
+  // Better / terminal node -> Done
+  const auto alpha0 = alpha;
+  if ((alpha = std::max(alpha, eval)) >= beta) {
+    QStore(hash, entry, alpha, raw_eval, Bound::kLower, 0);
+    return alpha;
+  }
+  if (depth <= 0) return alpha;
+
+  auto *parent       = g_board;
+  const auto checks  = QChecksW(depth);
+  const auto moves_n = checks ? MgenW(ply) : MgenCapturesW(ply);
+  const auto hash_move = entry.best_move(hash);
+  std::uint16_t best_move = 0;
+  for (auto i = 0; hash_move && i < moves_n; i += 1)
+    if (g_move_list[ply][i] == hash_move) g_move_scores[ply][i] += 10000;
   for (auto i = 0; i < moves_n; i += 1) {
     LazySort(ply, i, moves_n); // Very few moves, sort them all
-    g_board = g_boards[ply] + i;
-    if ((alpha = std::max(alpha, QSearchB(alpha, beta, depth - 1, ply + 1))) >= beta) return alpha;
+    const auto move = g_move_list[ply][i];
+    g_board = parent;
+    if (!checks && (!IsGoodCapture(true, move) || eval + DeltaValue(move) + DELTA_MARGIN <= alpha)) continue;
+    MakeMoveW(parent, ply, move);
+    if (const auto score = QSearchB(alpha, beta, depth - 1, ply + 1); score > alpha) {
+      best_move = move;
+      if ((alpha = score) >= beta) break;
+    }
   }
 
+  QStore(hash, entry, alpha, raw_eval,
+    alpha >= beta ? Bound::kLower : (alpha > alpha0 ? Bound::kExact : Bound::kUpper), best_move);
   return alpha;
 }
 
 int QSearchB(const int alpha, int beta, const int depth, const int ply) {
-  g_nodes += 1;
+  g_nodes[g_thread_id].add();
 
   if (g_stop_search) return 0;
-  if ((alpha >= (beta = std::min(beta, Evaluate(false)))) || depth <= 0) return beta;
 
-  const auto moves_n = MgenTacticalB(g_boards[ply]);
+  const auto hash  = g_board->hash;
+  const auto entry = GetHashBucket(hash)->find(hash);
+  if (entry.cutoff(hash, alpha, beta, 0)) return entry.score;
+  auto raw_eval = entry.static_eval(hash);
+  if (raw_eval == NO_EVAL) raw_eval = GetEval(false);
+  const auto eval = ScaleEval(false, raw_eval);
+
+  const auto beta0 = beta;
+  if (alpha >= (beta = std::min(beta, eval))) {
+    QStore(hash, entry, beta, raw_eval, Bound::kUpper, 0);
+    return beta;
+  }
+  if (depth <= 0) return beta;
+
+  auto *parent       = g_board;
+  const auto checks  = QChecksB(depth);
+  const auto moves_n = checks ? MgenB(ply) : MgenCapturesB(ply);
+  const auto hash_move = entry.best_move(hash);
+  std::uint16_t best_move = 0;
+  for (auto i = 0; hash_move && i < moves_n; i += 1)
+    if (g_move_list[ply][i] == hash_move) g_move_scores[ply][i] += 10000;
   for (auto i = 0; i < moves_n; i += 1) {
     LazySort(ply, i, moves_n);
-    g_board = g_boards[ply] + i;
-    if (alpha >= (beta = std::min(beta, QSearchW(alpha, beta, depth - 1, ply + 1)))) return beta;
+    const auto move = g_move_list[ply][i];
+    g_board = parent;
+    if (!checks && (!IsGoodCapture(false, move) || eval - DeltaValue(move) - DELTA_MARGIN >= beta)) continue;
+    MakeMoveB(parent, ply, move);
+    if (const auto score = QSearchW(alpha, beta, depth - 1, ply + 1); score < beta) {
+      best_move = move;
+      if (alpha >= (beta = score)) break;
+    }
   }
 
+  QStore(hash, entry, beta, raw_eval,
+    alpha >= beta ? Bound::kUpper : (beta < beta0 ? Bound::kExact : Bound::kLower), best_move);
   return beta;
 }
 
-void SetMoveAndPv(const int ply, const int move_i) {
-  g_board = g_boards[ply] + move_i;
-  g_is_pv = move_i <= 1 && !g_board->score;
+// Make the child -> Its key is known -> Prefetch its hash slot before descending
+void SetMove(const bool wtm, Board *parent, const int ply, const std::uint16_t move) {
+  g_stack[ply].move = move;
+  MakeMove(wtm, parent, ply, move);
+  __builtin_prefetch(GetHashBucket(g_board->hash));
+}
+
+void SetRootMove(const int i) {
+  SetMove(g_wtm, &g_board_empty, 0, g_move_list[0][i]);
+}
+
+// Static eval once per node ( Raw from the hashtable or full eval ). None in checks
+// Improving: Better than 2 plies ago ( Or unknown then ) -> Prune less
+void SetStaticEval(const bool wtm, const int ply, const int raw_eval) {
+  auto *stack      = g_stack + ply;
+  stack->raw_eval  = (wtm ? ChecksB() : ChecksW()) ? NO_EVAL : (raw_eval != NO_EVAL ? raw_eval : GetEval(wtm));
+  stack->eval      = stack->raw_eval == NO_EVAL ? NO_EVAL : ScaleEval(wtm, stack->raw_eval);
+  const auto prev  = ply >= 2 ? g_stack[ply - 2].eval : NO_EVAL;
+  stack->improving = stack->eval != NO_EVAL && (prev == NO_EVAL || (wtm ? stack->eval > prev : stack->eval < prev));
+}
+
+// Quiet move caused a cutoff -> Try it first in the siblings
+void UpdateKillers(const int ply, const std::uint16_t move) {
+  auto *killers = g_stack[ply].killers;
+  if (killers[0] == move) return;
+  killers[1] = killers[0];
+  killers[0] = move;
+}
+
+// Reward the cutoff move. Punish the quiets searched before it
+void UpdateQuietStats(const MovePicker &picker, const int depth, const std::uint16_t move,
+    const std::uint16_t *quiets, const int quiets_n) {
+  const auto bonus = std::min(16 * depth * depth, HISTORY_BONUS);
+  UpdateKillers(picker.ply, move);
+  UpdateQuietHistory(picker.parent, picker.wtm, picker.ply, move, +bonus);
+  for (auto i = 0; i < quiets_n; i += 1)
+    if (quiets[i] != move) UpdateQuietHistory(picker.parent, picker.wtm, picker.ply, quiets[i], -bonus);
+  if (picker.ply >= 1 && !g_boards[picker.ply - 1].is_nullmove()) {
+    const auto *board = g_boards + picker.ply - 1;
+    g_countermoves[board->pieces[board->to] + 6][board->to] = move;
+  }
 }
 
 int CalcLMR(const int depth, const int move_i) {
@@ -2282,97 +3408,209 @@ int CalcLMR(const int depth, const int move_i) {
 
 // a >= b -> Minimizer won't pick any better move anyway.
 //           So searching beyond is a waste of time.
-int SearchMovesW(int alpha, const int beta, int depth, const int ply) {
-  const auto hash    = g_r50_positions[g_board->fifty];
-  const auto checks  = ChecksB();
-  const auto moves_n = MgenW(g_boards[ply]);
-
-  // Checkmate or stalemate
-  if (!moves_n) return checks ? -INF : 0;
-  // Extend interesting path (SRE / CE / PPE)
-  if (moves_n == 1 || (depth == 1 && (checks || g_board->type == 8))) depth += 1;
-
-  const auto ok_lmr = moves_n >= 5 && depth >= 2 && !checks;
-  auto *entry       = &g_hash[static_cast<std::uint32_t>(hash % g_hash_entries)];
-  entry->put_hash_value_to_moves(hash, g_boards[ply]);
-
-  // Tiny speedup since not all moves are scored (lots of pointless shuffling ...)
-  // So avoid sorting useless moves
-  auto sort = true;
-  for (auto i = 0; i < moves_n; i += 1) {
-    if (sort) {
-      LazySort(ply, i, moves_n);
-      sort = g_boards[ply][i].score != 0;
-    }
-    SetMoveAndPv(ply, i);
-    if (ok_lmr && i >= 1 && !g_board->score && !ChecksW()) {
-      if (SearchB(alpha, beta, depth - 2 - CalcLMR(depth, i), ply + 1) <= alpha) continue;
-      SetMoveAndPv(ply, i);
+// Moves come from the staged picker -> Cut nodes generate only what they need
+// PVS: 1st move w/ full window. Rest w/ null window. Re-search only if it fails high in a pv node
+int SearchMovesW(int alpha, const int beta, int depth, const int ply, const std::uint16_t hash_move) {
+  const auto alpha0 = alpha;
+  const auto depth0 = depth;
+  const auto pv     = beta - alpha > 1;
+  const auto hash   = g_r50_positions[g_board->fifty];
+  const auto checks = ChecksB();
+  MovePicker picker{ .parent = g_board, .ply = ply, .wtm = true,
+                     .hash_move = hash_move,
+                     .killers = { g_stack[ply].killers[0], g_stack[ply].killers[1] },
+                     .counter_move = CounterMove(ply) };
+
+  if (checks) {
+    picker.evasions();
+    if (!picker.n) return -INF; // Checkmate
+  }
+  // Extend interesting path (SRE / CE / PPE). Only evasions are counted upfront
+  const auto extended = (checks && picker.n == 1) || (depth == 1 && (checks || picker.parent->type == 8));
+  if (extended) depth += 1;
+  // No hash move -> Cheaper search finds one for the next visit ( IIR )
+  else if (!picker.hash_move && depth >= IIR_DEPTH) depth -= 1;
+
+  const auto ok_lmr   = depth >= 2 && !checks;
+  const auto ok_prune = !pv && !checks && depth <= std::max(FUTILITY_DEPTH, LMP_DEPTH);
+  const auto eval     = g_stack[ply].eval;
+  const auto improving = g_stack[ply].improving;
+  std::uint16_t best_move = 0, first = 0, quiets[64]{};
+  auto moves_n = 0, quiets_n = 0;
+  for (auto move = picker.next(); move; move = picker.next()) {
+    const auto i = moves_n++;
+    if (!i) first = move;
+    // Late quiet w/o check in a non-pv node -> Too many tried ( LMP ) / Hopeless ( Futility )
+    // Check test last and on the parent: Pruned moves are never made
+    if (ok_prune && i >= 1 && picker.stage == Stage::kQuiets &&
+        ((depth <= LMP_DEPTH && i >= (LMP_BASE + depth * depth) / (2 - improving)) ||
+         (depth <= FUTILITY_DEPTH && eval + FUTILITY_MARGIN * depth <= alpha)) &&
+        (g_board = picker.parent, !QuietChecksW(ply, move))) continue;
+    SetMove(true, picker.parent, ply, move);
+    if (quiets_n < 64 && picker.is_quiet(move)) quiets[quiets_n++] = move;
+    auto score = alpha + 1; // 1st move -> Full window
+    if (i >= 1) {
+      const auto lmr = ok_lmr && picker.stage == Stage::kQuiets && !ChecksW() ? 1 + CalcLMR(depth, i) + !improving : 0;
+      score = SearchB(alpha, alpha + 1, depth - 1 - lmr, ply + 1);
+      if (lmr && score > alpha) {
+        g_board = g_boards + ply; // Back to the child
+        score   = SearchB(alpha, alpha + 1, depth - 1, ply + 1);
+      }
+      g_board = g_boards + ply;
     }
-    if (const auto score = SearchB(alpha, beta, depth - 1, ply + 1); score > alpha) { // Improved scope
+    if (score > alpha && (i == 0 || (pv && score < beta))) score = SearchB(alpha, beta, depth - 1, ply + 1);
+    if (score > alpha) { // Improved scope
+      best_move = move;
       if ((alpha = score) >= beta) {
-        entry->update<MoveType::kKiller>(hash, g_boards[ply][i].index);
-        return alpha;
+        if (picker.is_quiet(move)) UpdateQuietStats(picker, depth, move, quiets, quiets_n);
+        break;
       }
-      entry->update<MoveType::kGood>(hash, g_boards[ply][i].index);
     }
   }
 
-  return alpha;
-}
+  if (!moves_n) return 0; // Stalemate
 
-int SearchMovesB(const int alpha, int beta, int depth, const int ply) {
-  const auto hash    = g_r50_positions[g_board->fifty];
-  const auto checks  = ChecksW();
-  const auto moves_n = MgenB(g_boards[ply]);
+  // No cutoff and the picker ran out after 1 move -> Only move w/o checks. Search it again 1 ply deeper ( SRE )
+  if (moves_n == 1 && !extended && alpha < beta && !g_stop_search) {
+    SetMove(true, picker.parent, ply, first);
+    depth     = depth0 + 1;
+    alpha     = std::max(alpha0, SearchB(alpha0, beta, depth - 1, ply + 1));
+    best_move = alpha > alpha0 ? first : 0;
+  }
 
-  if (!moves_n) return checks ? +INF : 0;
-  if (moves_n == 1 || (depth == 1 && (checks || g_board->type == 8))) depth += 1;
+  if (!g_stop_search)
+    GetHashBucket(hash)->store(hash, alpha, g_stack[ply].raw_eval, depth,
+      alpha >= beta ? Bound::kLower : (alpha > alpha0 ? Bound::kExact : Bound::kUpper), best_move);
 
-  const auto ok_lmr = moves_n >= 5 && depth >= 2 && !checks;
-  auto *entry       = &g_hash[static_cast<std::uint32_t>(hash % g_hash_entries)];
-  entry->put_hash_value_to_moves(hash, g_boards[ply]);
+  return alpha;
+}
 
-  auto sort = true;
-  for (auto i = 0; i < moves_n; i += 1) {
-    if (sort) {
-      LazySort(ply, i, moves_n);
-      sort = g_boards[ply][i].score != 0;
-    }
-    SetMoveAndPv(ply, i);
-    if (ok_lmr && i >= 1 && !g_board->score && !ChecksB()) {
-      if (SearchW(alpha, beta, depth - 2 - CalcLMR(depth, i), ply + 1) >= beta) continue;
-      SetMoveAndPv(ply, i);
+int SearchMovesB(const int alpha, int beta, int depth, const int ply, const std::uint16_t hash_move) {
+  const auto beta0  = beta;
+  const auto depth0 = depth;
+  const auto pv     = beta - alpha > 1;
+  const auto hash   = g_r50_positions[g_board->fifty];
+  const auto checks = ChecksW();
+  MovePicker picker{ .parent = g_board, .ply = ply, .wtm = false,
+                     .hash_move = hash_move,
+                     .killers = { g_stack[ply].killers[0], g_stack[ply].killers[1] },
+                     .counter_move = CounterMove(ply) };
+
+  if (checks) {
+    picker.evasions();
+    if (!picker.n) return +INF;
+  }
+  const auto extended = (checks && picker.n == 1) || (depth == 1 && (checks || picker.parent->type == 8));
+  if (extended) depth += 1;
+  else if (!picker.hash_move && depth >= IIR_DEPTH) depth -= 1;
+
+  const auto ok_lmr   = depth >= 2 && !checks;
+  const auto ok_prune = !pv && !checks && depth <= std::max(FUTILITY_DEPTH, LMP_DEPTH);
+  const auto eval     = g_stack[ply].eval;
+  const auto improving = g_stack[ply].improving;
+  std::uint16_t best_move = 0, first = 0, quiets[64]{};
+  auto moves_n = 0, quiets_n = 0;
+  for (auto move = picker.next(); move; move = picker.next()) {
+    const auto i = moves_n++;
+    if (!i) first = move;
+    if (ok_prune && i >= 1 && picker.stage == Stage::kQuiets &&
+        ((depth <= LMP_DEPTH && i >= (LMP_BASE + depth * depth) / (2 - improving)) ||
+         (depth <= FUTILITY_DEPTH && eval - FUTILITY_MARGIN * depth >= beta)) &&
+        (g_board = picker.parent, !QuietChecksB(ply, move))) continue;
+    SetMove(false, picker.parent, ply, move);
+    if (quiets_n < 64 && picker.is_quiet(move)) quiets[quiets_n++] = move;
+    auto score = beta - 1;
+    if (i >= 1) {
+      const auto lmr = ok_lmr && picker.stage == Stage::kQuiets && !ChecksB() ? 1 + CalcLMR(depth, i) + !improving : 0;
+      score = SearchW(beta - 1, beta, depth - 1 - lmr, ply + 1);
+      if (lmr && score < beta) {
+        g_board = g_boards + ply;
+        score   = SearchW(beta - 1, beta, depth - 1, ply + 1);
+      }
+      g_board = g_boards + ply;
     }
-    if (const auto score = SearchW(alpha, beta, depth - 1, ply + 1); score < beta) {
+    if (score < beta && (i == 0 || (pv && score > alpha))) score = SearchW(alpha, beta, depth - 1, ply + 1);
+    if (score < beta) {
+      best_move = move;
       if (alpha >= (beta = score)) {
-        entry->update<MoveType::kKiller>(hash, g_boards[ply][i].index);
-        return beta;
+        if (picker.is_quiet(move)) UpdateQuietStats(picker, depth, move, quiets, quiets_n);
+        break;
       }
-      entry->update<MoveType::kGood>(hash, g_boards[ply][i].index);
     }
   }
 
+  if (!moves_n) return 0;
+
+  if (moves_n == 1 && !extended && alpha < beta && !g_stop_search) {
+    SetMove(false, picker.parent, ply, first);
+    depth     = depth0 + 1;
+    beta      = std::min(beta0, SearchW(alpha, beta0, depth - 1, ply + 1));
+    best_move = beta < beta0 ? first : 0;
+  }
+
+  if (!g_stop_search)
+    GetHashBucket(hash)->store(hash, beta, g_stack[ply].raw_eval, depth,
+      alpha >= beta ? Bound::kUpper : (beta < beta0 ? Bound::kExact : Bound::kLower), best_move);
+
   return beta;
 }
 
+// Shallow non-pv node w/o checks. Static eval decides
+// Far above beta -> Fail high ( Reverse futility ). Far below alpha -> Only captures can help ( Razoring )
+bool TryStaticPruningW(int *alpha, const int beta, const int depth, const int ply) {
+  const auto eval = g_stack[ply].eval;
+  if (beta - *alpha != 1 || depth > RFP_DEPTH || eval == NO_EVAL) return false;
+  if (eval - RFP_MARGIN * (depth - g_stack[ply].improving) >= beta) {
+    *alpha = eval;
+    return true;
+  }
+  if (depth <= RAZOR_DEPTH && eval + RAZOR_MARGIN * depth <= *alpha) {
+    auto *tmp        = g_board;
+    const auto score = QSearchW(*alpha, beta, g_q_depth, ply);
+    g_board          = tmp;
+    if (score <= *alpha) {
+      *alpha = score;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TryStaticPruningB(const int alpha, int *beta, const int depth, const int ply) {
+  const auto eval = g_stack[ply].eval;
+  if (*beta - alpha != 1 || depth > RFP_DEPTH || eval == NO_EVAL) return false;
+  if (eval + RFP_MARGIN * (depth - g_stack[ply].improving) <= alpha) {
+    *beta = eval;
+    return true;
+  }
+  if (depth <= RAZOR_DEPTH && eval - RAZOR_MARGIN * depth >= *beta) {
+    auto *tmp        = g_board;
+    const auto score = QSearchB(alpha, *beta, g_q_depth, ply);
+    g_board          = tmp;
+    if (score >= *beta) {
+      *beta = score;
+      return true;
+    }
+  }
+  return false;
+}
+
 // If we do nothing and we are still better -> Done
+// Static eval is taken from the hashtable or evaluated only when needed
 bool TryNullMoveW(int *alpha, const int beta, const int depth, const int ply) {
   if ((!g_nullmove_active) && // No nullmove on the path ?
-      (!g_is_pv) && // Not pv ?
+      (beta - *alpha == 1) && // Not pv ( Null window ) ?
       ( depth >= 3) && // Enough depth ( 2 blunders too much. 3 sweet spot ... ) ?
       ((g_board->white[1] | g_board->white[2] | g_board->white[3] | g_board->white[4]) ||
         (std::popcount(g_board->white[0]) >= 2)) && // Non pawn material or at least 2 pawns ( Zugzwang ... ) ?
       (!ChecksB()) && // Not under checks ?
-      ( Evaluate(true) >= beta)) { // Looks good ?
-    const auto ep     = g_board->epsq;
-    auto *tmp         = g_board;
-    g_board->epsq     = -1;
+      (g_stack[ply].eval >= beta)) { // Looks good ?
+    auto *parent      = g_board;
+    MakeNullMove(parent, ply);
     g_nullmove_active = true;
-    const auto score  = SearchB(*alpha, beta, depth - static_cast<int>(depth / 4 + 3), ply);
+    const auto score  = SearchB(*alpha, beta, depth - static_cast<int>(depth / 4 + 3), ply + 1);
     g_nullmove_active = false;
-    g_board           = tmp;
-    g_board->epsq     = ep;
+    g_board           = parent;
     if (score >= beta) {
       *alpha = score;
       return true;
@@ -2383,20 +3621,18 @@ bool TryNullMoveW(int *alpha, const int beta, const int depth, const int ply) {
 
 bool TryNullMoveB(const int alpha, int *beta, const int depth, const int ply) {
   if ((!g_nullmove_active) &&
-      (!g_is_pv) &&
+      (*beta - alpha == 1) &&
       ( depth >= 3) &&
       ((g_board->black[1] | g_board->black[2] | g_board->black[3] | g_board->black[4]) ||
         (std::popcount(g_board->black[0]) >= 2)) &&
       (!ChecksW()) &&
-      ( alpha >= Evaluate(false))) {
-    const auto ep     = g_board->epsq;
-    auto *tmp         = g_board;
-    g_board->epsq     = -1;
+      ( alpha >= g_stack[ply].eval)) {
+    auto *parent      = g_board;
+    MakeNullMove(parent, ply);
     g_nullmove_active = true;
-    const auto score  = SearchW(alpha, *beta, depth - static_cast<int>(depth / 4 + 3), ply);
+    const auto score  = SearchW(alpha, *beta, depth - static_cast<int>(depth / 4 + 3), ply + 1);
     g_nullmove_active = false;
-    g_board           = tmp;
-    g_board->epsq     = ep;
+    g_board           = parent;
     if (alpha >= score) {
       *beta = score;
       return true;
@@ -2407,66 +3643,83 @@ bool TryNullMoveB(const int alpha, int *beta, const int depth, const int ply) {
 
 // Front-end for ab-search
 int SearchW(int alpha, const int beta, const int depth, const int ply) {
-  g_nodes += 1;
+  g_nodes[g_thread_id].add();
 
-  if (g_stop_search || (g_stop_search = CheckTime())) return 0; // Search is stopped. Return ASAP
+  if (g_stop_search || CheckTime()) return 0; // Search is stopped. Return ASAP
   if (depth <= 0 || ply >= MAX_SEARCH_DEPTH) return QSearchW(alpha, beta, g_q_depth, ply);
 
-  const auto fifty = g_board->fifty;
-  const auto tmp   = g_r50_positions[fifty];
-
-  if (TryNullMoveW(&alpha, beta, depth, ply)) return alpha;
+  const auto fifty  = g_board->fifty;
+  const auto tmp    = g_r50_positions[fifty];
+  const auto hash   = g_board->hash;
+  const auto entry  = GetHashBucket(hash)->find(hash);
 
-  g_r50_positions[fifty] = Hash(true);
-  alpha                  = Draw(true) ? 0 : SearchMovesW(alpha, beta, depth, ply);
+  g_r50_positions[fifty] = hash;
+  if (Draw(true)) {
+    alpha = 0;
+  } else if (entry.cutoff(hash, alpha, beta, depth)) { // Hashtable cutoff
+    alpha = entry.score;
+  } else {
+    SetStaticEval(true, ply, entry.static_eval(hash));
+    if (!TryStaticPruningW(&alpha, beta, depth, ply) && !TryNullMoveW(&alpha, beta, depth, ply))
+      alpha = SearchMovesW(alpha, beta, depth, ply, entry.best_move(hash));
+  }
   g_r50_positions[fifty] = tmp;
 
   return alpha;
 }
 
 int SearchB(const int alpha, int beta, const int depth, const int ply) {
-  g_nodes += 1;
+  g_nodes[g_thread_id].add();
 
   if (g_stop_search) return 0;
   if (depth <= 0 || ply >= MAX_SEARCH_DEPTH) return QSearchB(alpha, beta, g_q_depth, ply);
 
-  const auto fifty = g_board->fifty;
-  const auto tmp   = g_r50_positions[fifty];
+  const auto fifty  = g_board->fifty;
+  const auto tmp    = g_r50_positions[fifty];
+  const auto hash   = g_board->hash;
+  const auto entry  = GetHashBucket(hash)->find(hash);
 
-  if (TryNullMoveB(alpha, &beta, depth, ply)) return beta;
-
-  g_r50_positions[fifty] = Hash(false);
-  beta                   = Draw(false) ? 0 : SearchMovesB(alpha, beta, depth, ply);
+  g_r50_positions[fifty] = hash;
+  if (Draw(false)) {
+    beta = 0;
+  } else if (entry.cutoff(hash, alpha, beta, depth)) {
+    beta = entry.score;
+  } else {
+    SetStaticEval(false, ply, entry.static_eval(hash));
+    if (!TryStaticPruningB(alpha, &beta, depth, ply) && !TryNullMoveB(alpha, &beta, depth, ply))
+      beta = SearchMovesB(alpha, beta, depth, ply, entry.best_move(hash));
+  }
   g_r50_positions[fifty] = tmp;
 
   return beta;
 }
 
-int FindBestW(const int i, const int alpha) {
+int FindBestW(const int i, const int alpha, const int beta) {
   if (g_depth >= 1 && i >= 1) { // Null window search for bad moves
     if (const int score = SearchB(alpha, alpha + 1, g_depth, 1); score > alpha) {
-      SetMoveAndPv(0, i);
-      return SearchB(alpha, +INF, g_depth, 1); // Search w/ full window
+      SetRootMove(i);
+      return SearchB(alpha, beta, g_depth, 1); // Search w/ full window
     } else {
       return score;
     }
   }
-  return SearchB(alpha, +INF, g_depth, 1);
+  return SearchB(alpha, beta, g_depth, 1);
 }
 
-// Root search
-int SearchRootW() {
-  int best_i = 0, alpha = -INF;
+// Root search. Fail high -> Stop and put the move first
+int SearchRootW(int alpha, const int beta) {
+  auto best_i = 0;
 
   for (auto i = 0; i < g_root_n; i += 1) {
-    SetMoveAndPv(0, i); // 1 / 2 moves too good and not tactical -> pv
-    const auto score = FindBestW(i, alpha);
+    SetRootMove(i);
+    const auto score = FindBestW(i, alpha, beta);
     if (g_stop_search) return g_best_score; // Scores are rubbish now
     if (score > alpha) {
       // Skip underpromos unless really good ( 3+ pawns )
-      if (g_boards[0][i].is_underpromo() && ((score + (3 * 100)) < alpha)) continue;
+      if (MoveType(g_move_list[0][i]) >= 5 && MoveType(g_move_list[0][i]) <= 7 && ((score + (3 * 100)) < alpha)) continue;
       alpha  = score;
       best_i = i;
+      if (alpha >= beta) break;
     }
   }
 
@@ -2474,29 +3727,30 @@ int SearchRootW() {
   return alpha;
 }
 
-int FindBestB(const int i, const int beta) {
+int FindBestB(const int i, const int alpha, const int beta) {
   if (g_depth >= 1 && i >= 1) {
     if (const int score = SearchW(beta - 1, beta, g_depth, 1); score < beta) {
-      SetMoveAndPv(0, i);
-      return SearchW(-INF, beta, g_depth, 1);
+      SetRootMove(i);
+      return SearchW(alpha, beta, g_depth, 1);
     } else {
       return score;
     }
   }
-  return SearchW(-INF, beta, g_depth, 1);
+  return SearchW(alpha, beta, g_depth, 1);
 }
 
-int SearchRootB() {
-  int best_i = 0, beta = +INF;
+int SearchRootB(const int alpha, int beta) {
+  auto best_i = 0;
 
   for (auto i = 0; i < g_root_n; i += 1) {
-    SetMoveAndPv(0, i);
-    const auto score = FindBestB(i, beta);
+    SetRootMove(i);
+    const auto score = FindBestB(i, alpha, beta);
     if (g_stop_search) return g_best_score;
     if (score < beta) {
-      if (g_boards[0][i].is_underpromo() && ((score - (3 * 100)) > beta)) continue;
+      if (MoveType(g_move_list[0][i]) >= 5 && MoveType(g_move_list[0][i]) <= 7 && ((score - (3 * 100)) > beta)) continue;
       beta   = score;
       best_i = i;
+      if (alpha >= beta) break;
     }
   }
 
@@ -2504,6 +3758,22 @@ int SearchRootB() {
   return beta;
 }
 
+// Aspiration windows: Search around the last score first. Widen geometrically on fail low / high
+int SearchRoot(const std::uint64_t start) {
+  if (g_depth < ASPIRATION_DEPTH || std::abs(g_best_score) >= ASPIRATION_MAX)
+    return g_wtm ? SearchRootW(-INF, +INF) : SearchRootB(-INF, +INF);
+
+  auto alpha = g_best_score - ASPIRATION_WINDOW, beta = g_best_score + ASPIRATION_WINDOW;
+  for (auto delta = 2 * ASPIRATION_WINDOW; ; delta *= 2) {
+    const auto score = g_wtm ? SearchRootW(alpha, beta) : SearchRootB(alpha, beta);
+    if (g_stop_search || ((score > alpha || alpha == -INF) && (score < beta || beta == +INF))) return score;
+    const auto fail_low = score <= alpha; // White POV
+    if (!g_thread_id) SpeakUci(score, Now() - start, fail_low == g_wtm ? Bound::kUpper : Bound::kLower);
+    if (fail_low) alpha = delta >= ASPIRATION_MAX ? -INF : std::max(-INF, score - delta);
+    else          beta  = delta >= ASPIRATION_MAX ? +INF : std::min(+INF, score + delta);
+  }
+}
+
 // struct Material
 
 // KRRvKR / KRvKRR / KRRRvK / KvKRRR ?
@@ -2553,17 +3823,22 @@ bool ClassicalActivation(const Material &m) {
   return (!g_nnue_exist) || m.is_easy() || m.is_rook_ending() || m.is_weird();
 }
 
+// Small NNUE ( If any ) for short searches and endgames. Not for analysis
+bool UseSmallNet(const int ms, const Material &m) {
+  return g_nnue_nets[1] && !g_analyzing && (ms < SMALL_NET_MS || m.is_endgame());
+}
+
 // Play the book move from root list
 bool FindBookMove(const int from, const int to, const int type) {
   if (type) { // Castling or promotion
     for (auto i = 0; i < g_root_n; i += 1)
-      if (g_boards[0][i].type == type) {
+      if (MoveType(g_move_list[0][i]) == type) {
         SwapMoveInRootList(i);
         return true;
       }
   } else {
     for (auto i = 0; i < g_root_n; i += 1)
-      if (g_boards[0][i].from == from && g_boards[0][i].to == to) {
+      if (MoveFrom(g_move_list[0][i]) == from && MoveTo(g_move_list[0][i]) == to) {
         SwapMoveInRootList(i);
         return true;
       }
@@ -2620,7 +3895,7 @@ void SearchRootMoves(const bool is_eg) {
 
   for ( ; std::abs(g_best_score) != INF && g_depth < g_max_depth && !g_stop_search; g_depth += 1) {
     g_q_depth = std::min(g_q_depth + 2, MAX_Q_SEARCH_DEPTH);
-    g_best_score = g_wtm ? SearchRootW() : SearchRootB();
+    g_best_score = SearchRoot(start);
     // Switch to classical only when the game is decided ( 4+ pawns ) !
     g_classical = g_classical || (is_eg && std::abs(g_best_score) > (4 * 100) && ((++good) >= 7));
     SpeakUci(g_best_score, Now() - start);
@@ -2630,19 +3905,76 @@ void SearchRootMoves(const bool is_eg) {
   if (!g_q_depth) SpeakUci(g_last_eval, Now() - start); // Nothing searched -> Print smt for UCI
 }
 
+// struct RootCopy
+
+// Copy the root of the main thread ( Before any searching )
+RootCopy::RootCopy() : board{g_board_empty}, moves{g_move_list[0] + 0, g_move_list[0] + g_root_n},
+  scores{g_move_scores[0] + 0, g_move_scores[0] + g_root_n},
+  r50_positions{g_r50_positions + 0, g_r50_positions + R50_ARR}, classical{g_classical},
+  nnue_net{g_nnue_net} { }
+
+// Setup the root for a helper thread
+void RootCopy::setup() const {
+  g_board_empty = this->board;
+  g_board       = &g_board_empty;
+  g_root_n      = static_cast<int>(this->moves.size());
+  g_classical   = this->classical;
+  g_nnue_net    = this->nnue_net;
+  std::copy(this->moves.begin(), this->moves.end(), g_move_list[0]);
+  std::copy(this->scores.begin(), this->scores.end(), g_move_scores[0]);
+  std::copy(this->r50_positions.begin(), this->r50_positions.end(), g_r50_positions);
+}
+
+// Lazy SMP helper. Iterate the same root with the shared hashtable
+// Odd threads skip a depth ahead to diversify the search
+void HelperSearch(const int id, const RootCopy *root) {
+  g_thread_id = id;
+  root->setup();
+  for (g_depth = id & 0x1; std::abs(g_best_score) != INF && g_depth < g_max_depth && !g_stop_search; g_depth += 1) {
+    g_q_depth    = std::min(g_q_depth + 2, MAX_Q_SEARCH_DEPTH);
+    g_best_score = SearchRoot(0);
+  }
+}
+
+// Main thread searches and reports. Helpers only fill the hashtable
+void SearchRootMovesSmp(const bool is_eg) {
+  const RootCopy root{};
+  std::vector<std::thread> helpers{};
+  for (auto i = 1; i < g_threads; i += 1) helpers.emplace_back(HelperSearch, i, &root);
+  SearchRootMoves(is_eg);
+  g_stop_search = true; // Main is done -> Stop helpers
+  for (auto &helper : helpers) helper.join();
+}
+
+// New game -> Nothing learned carries over
+void ClearHistory() {
+  std::memset(g_countermoves, 0, sizeof(g_countermoves));
+  std::memset(g_history, 0, sizeof(g_history));
+  std::memset(g_cont_history, 0, sizeof(g_cont_history));
+}
+
+// Next move of the same game -> Keep the ordering knowledge but halve it
+void AgeHistory() {
+  for (auto &entry : std::span(&g_history[0][0][0], sizeof(g_history) / sizeof(std::int16_t))) entry /= 2;
+  for (auto &entry : std::span(&g_cont_history[0][0][0][0], sizeof(g_cont_history) / sizeof(std::int16_t))) entry /= 2;
+}
+
 // Reset search status
 void ResetThink() {
   g_stop_search     = false;
   g_nullmove_active = false;
-  g_is_pv           = false;
   g_q_depth         = 0;
   g_best_score      = 0;
-  g_nodes           = 0;
   g_depth           = 0;
+  std::fill(std::begin(g_stack), std::end(g_stack), SearchStack{});
+  g_accumulators[0].computedAccumulation = false;
+  AgeHistory();
+  ResetNodes();
 }
 
 void Think(const int ms) {
   g_stop_search_time = Now(static_cast<std::uint64_t>(ms)); // Start clock early
+  g_hash_generation  = (g_hash_generation + 1) & 0x3F; // Older entries get replaced first
   ResetThink();
   MgenRoot();
   if (!g_analyzing && PlayFastMove(ms)) return;
@@ -2651,12 +3983,13 @@ void Think(const int ms) {
   const Material m{ .white_n = std::popcount(White()),
                     .black_n = std::popcount(Black()) };
   g_classical = ClassicalActivation(m);
+  g_nnue_net  = UseSmallNet(ms, m) ? 1 : 0;
   EvalRootMoves();
   SortRootMoves();
 
   // Only =q and =n are allowed for gameplay
   g_underpromos = g_analyzing; // Can be removed ...
-  SearchRootMoves(m.is_endgame());
+  SearchRootMovesSmp(m.is_endgame());
   g_underpromos = true;
   g_board       = tmp; // Just in case ...
 }
@@ -2665,12 +3998,13 @@ void Think(const int ms) {
 
 std::uint64_t Perft(const bool wtm, const int depth, const int ply) {
   if (depth <= 0) return 1;
-  const auto moves_n = wtm ? MgenW(g_boards[ply]) : MgenB(g_boards[ply]);
+  auto *parent       = g_board;
+  const auto moves_n = wtm ? MgenW(ply) : MgenB(ply);
   if (depth == 1) return moves_n; // Bulk counting
   std::uint64_t nodes = 0;
   for (auto i = 0; i < moves_n; i += 1) {
-    g_board = g_boards[ply] + i;
-    nodes  += Perft(!wtm, depth - 1, ply + 1);
+    MakeMove(wtm, parent, ply, g_move_list[ply][i]);
+    nodes += Perft(!wtm, depth - 1, ply + 1);
   }
   return nodes;
 }
@@ -2679,8 +4013,9 @@ std::uint64_t Perft(const bool wtm, const int depth, const int ply) {
 
 void UciMake(const int root_i) {
   if (!g_wtm) g_fullmoves += 1; // Increase fullmoves only after black move
-  g_r50_positions[std::min(g_board->fifty, static_cast<std::uint8_t>(R50_ARR - 1))] = Hash(g_wtm); // Set hash
-  g_board_empty = g_boards[0][root_i]; // Copy current board
+  g_r50_positions[std::min(g_board->fifty, static_cast<std::uint8_t>(R50_ARR - 1))] = g_board->hash; // Set hash
+  MakeMove(g_wtm, &g_board_empty, 0, g_move_list[0][root_i]);
+  g_board_empty = g_boards[0]; // Copy current board
   g_board       = &g_board_empty; // Set pointer ( g_board must always point to smt )
   g_wtm         = !g_wtm; // Flip the board
 }
@@ -2689,7 +4024,7 @@ void UciMakeMove() {
   const auto move = TokenGetNth();
   MgenRoot();
   for (auto i = 0; i < g_root_n; i += 1)
-    if (move == g_boards[0][i].movename()) {
+    if (move == MoveName(g_move_list[0][i])) {
       UciMake(i);
       return;
     }
@@ -2728,6 +4063,20 @@ void UciSetHash() {
   SetHashtable(TokenGetNumber(3));
 }
 
+void UciSetEvalHash() {
+  SetEvalHash(TokenGetNumber(3));
+}
+
+void UciSetThreads() {
+  g_threads = std::clamp(TokenGetNumber(3), 1, MAX_THREADS);
+}
+
+void UciSetLargePages() {
+  const std::string mode = TokenGetNth(3);
+  g_page_mode = mode == "HugeTLB" ? PageMode::kHugeTLB : (mode == "Off" ? PageMode::kOff : PageMode::kTHP);
+  SetHashtable(static_cast<int>((g_hash_buckets * sizeof(HashBucket)) >> 20)); // Realloc w/ same size
+}
+
 void UciSetLevel() {
   g_level = std::clamp(TokenGetNumber(3), 0, 100);
 }
@@ -2740,22 +4089,31 @@ void UciSetEvalFile() {
   SetNNUE(TokenGetNth(3));
 }
 
+void UciSetEvalFileSmall() {
+  SetNNUE(TokenGetNth(3), 1);
+}
+
 void UciSetBookFile() {
   SetBook(TokenGetNth(3));
 }
 
 void UciSetoption() {
+  if (TokenPeek("name") && TokenPeek("Clear", 1) && TokenPeek("Hash", 2)) { ClearHash(); return; } // Button
   if (!TokenPeek("name") || !TokenPeek("value", 2)) return;
   if (     TokenPeek("UCI_Chess960", 1)) UciSetChess960();
   else if (TokenPeek("Hash", 1))         UciSetHash();
+  else if (TokenPeek("EvalHash", 1))     UciSetEvalHash();
+  else if (TokenPeek("Threads", 1))      UciSetThreads();
+  else if (TokenPeek("LargePages", 1))   UciSetLargePages();
   else if (TokenPeek("Level", 1))        UciSetLevel();
   else if (TokenPeek("MoveOverhead", 1)) UciSetMoveOverhead();
   else if (TokenPeek("EvalFile", 1))     UciSetEvalFile();
+  else if (TokenPeek("EvalFileSmall", 1)) UciSetEvalFileSmall();
   else if (TokenPeek("BookFile", 1))     UciSetBookFile();
 }
 
 void PrintBestMove() {
-  std::cout << "bestmove " << (g_root_n <= 0 ? "0000" : g_boards[0][0].movename()) << std::endl;
+  std::cout << "bestmove " << (g_root_n <= 0 ? "0000" : MoveName(g_move_list[0][0])) << std::endl;
 }
 
 void UciGoInfinite() {
@@ -2823,7 +4181,12 @@ void UciUci() {
     "option name Level type spin default " << LEVEL << " min 0 max 100\n" <<
     "option name MoveOverhead type spin default " << MOVEOVERHEAD << " min 0 max 100000\n" <<
     "option name Hash type spin default " << DEF_HASH_MB << " min 1 max 1048576\n" <<
+    "option name EvalHash type spin default " << DEF_EVAL_HASH_MB << " min 1 max 4096\n" <<
+    "option name Threads type spin default 1 min 1 max " << MAX_THREADS << '\n' <<
+    "option name LargePages type combo default THP var Off var THP var HugeTLB\n" <<
+    "option name Clear Hash type button\n" <<
     "option name EvalFile type string default " << EVAL_FILE << '\n' <<
+    "option name EvalFileSmall type string default " << EVAL_FILE_SMALL << '\n' <<
     "option name BookFile type string default " << BOOK_FILE << '\n' <<
     "uciok" << std::endl;
 }
@@ -2854,11 +4217,11 @@ void PerftUtil(const int depth, const std::string fen) {
   SetFen(fen);
   MgenRoot();
   for (auto i = 0; i < g_root_n; i += 1) {
-    g_board           = g_boards[0] + i;
+    MakeMove(g_wtm, &g_board_empty, 0, g_move_list[0][i]);
     const auto start  = Now();
     const auto nodes2 = depth >= 0 ? Perft(!g_wtm, depth - 1, 1) : 0;
     const auto ms     = Now() - start;
-    std::cout << (i + 1) << ". " << g_boards[0][i].movename() << " -> " <<
+    std::cout << (i + 1) << ". " << MoveName(g_move_list[0][i]) << " -> " <<
                  nodes2 << " (" << ms << " ms)" << std::endl;
     nodes    += nodes2;
     total_ms += ms;
@@ -2872,11 +4235,13 @@ void PerftUtil(const int depth, const std::string fen) {
 void Bench(const int depth, const int time) {
   const Save save{};
   SetHashtable(); // Reset hash
+  ClearEvalHash();
+  ClearHistory();
   g_max_depth  = depth;
   g_noise      = 0; // Make search deterministic
   g_nnue_exist = false;
   g_book_exist = false; // Disable book + nnue
-  std::uint64_t nodes = 0, total_ms = 0;
+  std::uint64_t nodes = 0, total_ms = 0, eval_probes = 0, eval_hits = 0;
   int n = 0, correct = 0;
   for (const std::string &fen2 : kBench) {
     for (std::size_t i = 0; i < 2; i += 1) {
@@ -2885,10 +4250,12 @@ void Bench(const int depth, const int time) {
       SetFen(fen);
       const std::uint64_t start = Now();
       Think(time);
-      total_ms += Now() - start;
-      nodes    += g_nodes;
+      total_ms    += Now() - start;
+      nodes       += Nodes();
+      eval_probes += SumCounters(&NodeCounter::eval_probes);
+      eval_hits   += SumCounters(&NodeCounter::eval_hits);
       std::cout << std::endl;
-      if (g_boards[0][0].movename() == fen.substr(fen.rfind(" bm ") + 4)) correct += 1;
+      if (MoveName(g_move_list[0][0]) == fen.substr(fen.rfind(" bm ") + 4)) correct += 1;
     }
   }
   g_noise     = NOISE;
@@ -2897,7 +4264,8 @@ void Bench(const int depth, const int time) {
     "Result:   " << correct << " / " << (2 * kBench.size()) << '\n' <<
     "Nodes:    " << nodes << '\n' <<
     "Time(ms): " << total_ms << '\n' <<
-    "NPS:      " << Nps(nodes, total_ms) << std::endl;
+    "NPS:      " << Nps(nodes, total_ms) << '\n' <<
+    "EvalHit:  " << (100 * eval_hits / std::max<std::uint64_t>(1, eval_probes)) << "%" << std::endl;
 }
 
 // Show signature of the program
@@ -2934,6 +4302,14 @@ void UciPerft() {
             fen.length() ? fen : STARTPOS);
 }
 
+// Convert an NNUE file into the mapped format of this binary ( See nnue::nnue_convert )
+// info string Wrote nn-cb80fb9393af.nnue.avx2
+void UciConvert() {
+  const std::string in  = TokenIsOk(0) ? TokenGetNth(0) : EVAL_FILE;
+  const std::string out = TokenIsOk(1) ? TokenGetNth(1) : in + "." + nnue::nnue_kernels();
+  std::cout << "info string " << (nnue::nnue_convert(in.c_str(), out.c_str()) ? "Wrote " + out : "Can't convert " + in) << std::endl;
+}
+
 void UciPrintLogo() {
   std::cout <<
     "___  ___            _ \n"
@@ -2969,11 +4345,15 @@ void UciHelp() {
     "bench [depth = 14]\n"  <<
     "  Show signature of the program\n\n" <<
     "speed [ms = 10000]\n"  <<
-    "  Show speed of the program" << std::endl;
+    "  Show speed of the program\n\n" <<
+    "convert [nnue = " << EVAL_FILE << "] [out = nnue.kernels]\n" <<
+    "  Write the NNUE file in the mapped format of this binary ( Set it as EvalFile )" << std::endl;
 }
 
 void UciNewGame() {
   g_last_eval = 0;
+  ClearHash(); // No stale entries from the previous game
+  ClearHistory();
 }
 
 void UciReadyOk() {
@@ -3001,6 +4381,7 @@ bool UciCommands() {
   else if (Token("speed"))      UciSpeed();
   else if (Token("perft"))      UciPerft();
   else if (Token("p"))          UciPrintBoard();
+  else if (Token("convert"))    UciConvert();
   else                          UciUnknownCommand();
 
   return g_game_on;
@@ -3054,6 +4435,21 @@ void InitBishopMagics() {
   }
 }
 
+// Squares between 2 squares + The whole line through them ( For pins + evasions )
+void InitBetweenAndLines() {
+  for (auto i = 0; i < 64; i += 1)
+    for (auto j = 0; j < 64; j += 1) {
+      if (i == j) continue;
+      if (GetBishopMagicMoves(i, 0) & Bit(j)) {
+        g_between[i][j] = GetBishopMagicMoves(i, Bit(j)) & GetBishopMagicMoves(j, Bit(i));
+        g_line[i][j]    = (GetBishopMagicMoves(i, 0) & GetBishopMagicMoves(j, 0)) | Bit(i) | Bit(j);
+      } else if (GetRookMagicMoves(i, 0) & Bit(j)) {
+        g_between[i][j] = GetRookMagicMoves(i, Bit(j)) & GetRookMagicMoves(j, Bit(i));
+        g_line[i][j]    = (GetRookMagicMoves(i, 0) & GetRookMagicMoves(j, 0)) | Bit(i) | Bit(j);
+      }
+    }
+}
+
 void InitRookMagics() {
   const std::vector<int> rook_vectors = {+1, 0, 0, +1, 0, -1, -1, 0};
   for (std::size_t i = 0; i < 64; i += 1) {
@@ -3103,16 +4499,19 @@ void InitZobrist() {
 }
 
 void PrintVersion() {
-  std::cout << VERSION << " by Toni Helminen" << std::endl;
+  std::cout << VERSION << " by Toni Helminen ( " << nnue::nnue_kernels() << (HasFastPext() ? " + pext" : "") << " )" << std::endl;
 }
 
 // Mayhem initialization (required)
 void Init() {
+  g_pext = HasFastPext(); // Before the slider tables
   InitBishopMagics();
   InitRookMagics();
+  InitBetweenAndLines();
   InitJumpMoves();
   InitZobrist();
   SetHashtable();
+  SetEvalHash();
   SetNNUE();
   SetBook();
   SetFen();
@@ -43,7 +43,10 @@ extern "C" {
 #include <ctype.h>
 #include <inttypes.h>
 
-#if defined(USE_AVX2)
+#if defined(NNUE_DISPATCH)
+#include <immintrin.h>
+#include <cpuid.h>
+#elif defined(USE_AVX2)
 #include <immintrin.h>
 #elif defined(USE_SSE41)
 #include <smmintrin.h>
@@ -229,6 +232,12 @@ typedef struct {
   bool computedAccumulation;
 } Accumulator;
 
+/*length of a layout name + 1*/
+#define NNUE_LAYOUT_SIZE 17
+
+/*weights of one NNUE file. Several nets can be loaded at once*/
+typedef struct Network Network;
+
 /*position*/
 typedef struct Position {
   int player;
@@ -237,14 +246,47 @@ typedef struct Position {
   Accumulator accumulator;
 } Position;
 
-int nnue_evaluate_pos(Position* pos);
+/*pieces changed by a move ( kings excluded )*/
+typedef struct {
+  int king_squares[2];   /** White and black king squares after the move */
+  bool king_moved[2];    /** Perspective must be refreshed */
+  int n_removed, n_added;
+  int removed_pieces[3], removed_squares[3];
+  int added_pieces[3], added_squares[3];
+} DirtyPieces;
+
+int nnue_evaluate_pos(const Network* net, Position* pos);
+
+/**
+* Load NNUE file. Returns NULL on failure.
+* The net is complete when returned, so swapping it in for
+* another one never exposes half-written weights.
+* A mapped file reports the kernels it was converted for in layout,
+* so the caller can tell a file of another build from a broken one
+*/
+
+Network* nnue_load(
+  const char * evalFile,            /** Path to NNUE file */
+  char * layout                     /** Out: NNUE_LAYOUT_SIZE chars, "" if not mapped. NULL is fine */
+);
+
+/**
+* Release a net of nnue_load. NULL is fine
+*/
+
+void nnue_free(
+  Network * net                     /** Net to release */
+);
 
 /**
-* Load NNUE file
+* Convert an NNUE file into the mapped format of the kernels in use.
+* nnue_load takes both formats. A mapped file is used in place from a
+* shared read-only mapping instead of being copied into every process
 */
 
-bool nnue_init(
-  const char * evalFile             /** Path to NNUE file */
+bool nnue_convert(
+  const char * evalFile,            /** Path to NNUE file */
+  const char * outFile              /** Path of the mapped file to write */
 );
 
 /**
@@ -264,11 +306,44 @@ bool nnue_init(
 *     piece[n+1] is set to 0 to represent end of array
 */
 int nnue_evaluate(
+  const Network* net,               /** Net to evaluate with */
   int player,                       /** Side to move */
   int* pieces,                      /** Array of pieces */
   int* squares                      /** Corresponding array of squares the piece stand on */
 );
 
+/**
+* Incremental evaluation. The engine keeps one accumulator per ply:
+* refresh it from the piece list at the root, update it from the
+* parent accumulator with the pieces the move changed everywhere else.
+*/
+void nnue_refresh_accumulator(
+  const Network* net,               /** Net to evaluate with */
+  Accumulator* accumulator,         /** Accumulator to fill */
+  int* pieces,                      /** Array of pieces ( See nnue_evaluate ) */
+  int* squares                      /** Corresponding array of squares */
+);
+
+void nnue_update_accumulator(
+  const Network* net,               /** Net of the parent accumulator */
+  Accumulator* accumulator,         /** Accumulator of the position after the move */
+  const Accumulator* parent,        /** Accumulator of the position before the move */
+  const DirtyPieces* dirty,         /** Pieces the move changed */
+  int* pieces,                      /** Piece list after the move. Needed only if a king moved */
+  int* squares                      /** Corresponding array of squares */
+);
+
+int nnue_evaluate_accumulator(
+  const Network* net,               /** Net the accumulator was computed with */
+  int player,                       /** Side to move */
+  Accumulator* accumulator          /** Computed accumulator of the position */
+);
+
+/**
+* Instruction set of the kernels in use ( e.g. "avx2" )
+*/
+const char* nnue_kernels(void);
+
 // nnue.hpp end
 
 // nnue.cpp start
@@ -277,7 +352,7 @@ int nnue_evaluate(
 // We need to hack around this when using AVX2 and AVX512.
 #if     defined(__GNUC__ ) && (__GNUC__ < 9) && defined(_WIN32) \
     && !defined(__clang__) && !defined(__INTEL_COMPILER) \
-    &&  defined(USE_AVX2)
+    && (defined(USE_AVX2) || defined(NNUE_DISPATCH))
 #define ALIGNMENT_HACK
 #endif
 
@@ -324,98 +399,6 @@ enum {
   FtOutDims = kHalfDimensions * 2
 };
 
-// USE_MMX generates _mm_empty() instructions, so undefine if not needed
-#if defined(USE_SSE2)
-#undef USE_MMX
-#endif
-
-static_assert(kHalfDimensions % 256 == 0, "kHalfDimensions should be a multiple of 256");
-
-#define VECTOR
-
-#ifdef USE_AVX512
-#define SIMD_WIDTH 512
-typedef __m512i vec16_t;
-typedef __m512i vec8_t;
-typedef __mmask64 mask_t;
-#define vec_add_16(a, b) _mm512_add_epi16(a, b)
-#define vec_sub_16(a, b) _mm512_sub_epi16(a, b)
-#define vec_packs(a, b) _mm512_packs_epi16(a, b)
-#define vec_mask_pos(a) _mm512_cmpgt_epi8_mask(a,_mm512_setzero_si512())
-#define NUM_REGS 8 // only 8 are needed
-
-#elif USE_AVX2
-#define SIMD_WIDTH 256
-typedef __m256i vec16_t;
-typedef __m256i vec8_t;
-typedef uint32_t mask_t;
-#define vec_add_16(a, b) _mm256_add_epi16(a, b)
-#define vec_sub_16(a, b) _mm256_sub_epi16(a, b)
-#define vec_packs(a, b) _mm256_packs_epi16(a, b)
-#define vec_mask_pos(a) _mm256_movemask_epi8(_mm256_cmpgt_epi8(a, _mm256_setzero_si256()))
-#define NUM_REGS 16
-
-#elif USE_SSE2
-#define SIMD_WIDTH 128
-typedef __m128i vec16_t;
-typedef __m128i vec8_t;
-typedef uint16_t mask_t;
-#define vec_add_16(a, b) _mm_add_epi16(a, b)
-#define vec_sub_16(a, b) _mm_sub_epi16(a, b)
-#define vec_packs(a, b) _mm_packs_epi16(a, b)
-#define vec_mask_pos(a) _mm_movemask_epi8(_mm_cmpgt_epi8(a, _mm_setzero_si128()))
-#ifdef IS_64BIT
-#define NUM_REGS 16
-#else
-#define NUM_REGS 8
-#endif
-
-#elif USE_MMX
-#define SIMD_WIDTH 64
-typedef __m64 vec16_t;
-typedef __m64 vec8_t;
-typedef uint8_t mask_t;
-#define vec_add_16(a, b) _mm_add_pi16(a, b)
-#define vec_sub_16(a, b) _mm_sub_pi16(a, b)
-#define vec_packs(a, b) _mm_packs_pi16(a, b)
-#define vec_mask_pos(a) _mm_movemask_pi8(_mm_cmpgt_pi8(a, _mm_setzero_si64()))
-#define NUM_REGS 8
-
-#elif USE_NEON
-#define SIMD_WIDTH 128
-typedef int16x8_t vec16_t;
-typedef int8x16_t vec8_t;
-typedef uint16_t mask_t;
-#define vec_add_16(a, b) vaddq_s16(a, b)
-#define vec_sub_16(a, b) vsubq_s16(a, b)
-#define vec_packs(a, b) vcombine_s8(vqmovn_s16(a), vqmovn_s16(b))
-#define vec_mask_pos(a) neon_movemask(vcgtq_s8(a, vdupq_n_u8(0)))
-#ifdef IS_64BIT
-#define NUM_REGS 16
-#else
-#define NUM_REGS 8
-#endif
-
-#else
-#undef VECTOR
-#define SIMD_WIDTH 16 // dummy
-typedef uint8_t mask_t; // dummy
-
-#endif
-
-#ifdef IS_64BIT
-typedef uint64_t mask2_t;
-#else
-typedef uint32_t mask2_t;
-#endif
-
-typedef int8_t clipped_t;
-#if defined(USE_MMX) || (defined(USE_SSE2) && !defined(USE_AVX2))
-typedef int16_t weight_t;
-#else
-typedef int8_t weight_t;
-#endif
-
 typedef struct {
   size_t size;
   unsigned values[30];
@@ -431,856 +414,298 @@ INLINE unsigned make_index(int c, int s, int pc, int ksq)
   return orient(c, s) + PieceToIndex[c][pc] + PS_END * ksq;
 }
 
-static void half_kp_append_active_indices(const Position *pos, const int c,
-    IndexList *active)
-{
-  int ksq = pos->squares[c ? 1 : 0];
-  ksq = orient(c, ksq);
-  for (int i = 2; pos->pieces[i]; ++i) {
-    int sq = pos->squares[i];
-    int pc = pos->pieces[i];
-    active->values[active->size++] = make_index(c, sq, pc, ksq);
-  }
-}
-
-static void append_active_indices(const Position *pos, IndexList active[2])
-{
-  for (unsigned c = 0; c < 2; ++c)
-    half_kp_append_active_indices(pos, c, &active[c]);
-}
-
-// InputLayer = InputSlice<256 * 2>
-// out: 512 x clipped_t
-
-// Hidden1Layer = ClippedReLu<AffineTransform<InputLayer, 32>>
-// 512 x clipped_t -> 32 x int32_t -> 32 x clipped_t
-
-// Hidden2Layer = ClippedReLu<AffineTransform<hidden1, 32>>
-// 32 x clipped_t -> 32 x int32_t -> 32 x clipped_t
-
-// OutputLayer = AffineTransform<HiddenLayer2, 1>
-// 32 x clipped_t -> 1 x int32_t
-
-#if !defined(USE_AVX512)
-static weight_t hidden1_weights alignas(64) [32 * 512];
-static weight_t hidden2_weights alignas(64) [32 * 32];
-#else
-static weight_t hidden1_weights alignas(64) [64 * 512];
-static weight_t hidden2_weights alignas(64) [64 * 32];
-#endif
-static weight_t output_weights alignas(64) [1 * 32];
-
-static int32_t hidden1_biases alignas(64) [32];
-static int32_t hidden2_biases alignas(64) [32];
-static int32_t output_biases[1];
-
-INLINE int32_t affine_propagate(clipped_t *input, int32_t *biases,
-    weight_t *weights)
-{
-#if defined(USE_AVX2)
-  __m256i *iv = (__m256i *)input;
-  __m256i *row = (__m256i *)weights;
-#if defined(USE_VNNI)
-  __m256i prod = _mm256_dpbusd_epi32(_mm256_setzero_si256(), iv[0], row[0]);
-#else
-  __m256i prod = _mm256_maddubs_epi16(iv[0], row[0]);
-  prod = _mm256_madd_epi16(prod, _mm256_set1_epi16(1));
-#endif
-  __m128i sum = _mm_add_epi32(
-      _mm256_castsi256_si128(prod), _mm256_extracti128_si256(prod, 1));
-  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x1b));
-  return _mm_cvtsi128_si32(sum) + _mm_extract_epi32(sum, 1) + biases[0];
-
-#elif defined(USE_SSE2)
-  __m128i *iv = (__m128i *)input;
-  __m128i *row = (__m128i *)weights;
-#if defined(AVOID_USE_SSSE3)
-  const __m128i kOnes = _mm_set1_epi16(1);
-  __m128i p0 = _mm_madd_epi16(_mm_maddubs_epi16(iv[0], row[0]), kOnes);
-  __m128i p1 = _mm_madd_epi16(_mm_maddubs_epi16(iv[1], row[1]), kOnes);
-  __m128i sum = _mm_add_epi32(p0, p1);
-#else
-  __m128i p0 = _mm_madd_epi16(iv[0], row[0]);
-  __m128i p1 = _mm_madd_epi16(iv[1], row[1]);
-  __m128i p2 = _mm_madd_epi16(iv[2], row[2]);
-  __m128i p3 = _mm_madd_epi16(iv[3], row[3]);
-  __m128i sum = _mm_add_epi32(_mm_add_epi32(p0, p1), _mm_add_epi32(p2, p3));
-#endif
-  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb));
-#if defined(USE_SSE41)
-  return _mm_cvtsi128_si32(sum) + _mm_extract_epi32(sum, 1) + biases[0];
-#else
-  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x1));
-  return _mm_cvtsi128_si32(sum) + biases[0];
-#endif
-
-#elif defined(USE_MMX)
-  __m64 *iv = (__m64 *)input;
-  __m64 s0 = _mm_setzero_si64(), s1 = s0;
-  __m64 *row = (__m64 *)weights;
-  for (unsigned j = 0; j < 4; ++j) {
-    s0 = _mm_add_pi32(s0, _mm_madd_pi16(row[2 * j], iv[2 * j]));
-    s1 = _mm_add_pi32(s1, _mm_madd_pi16(row[2 * j + 1], iv[2 * j + 1]));
-  }
-  __m64 sum = _mm_add_pi32(s0, s1);
-  sum = _mm_add_pi32(sum, _mm_unpackhi_pi32(sum, sum));
-  return _mm_cvtsi64_si32(sum) + biases[0];
-
-#elif defined(USE_NEON)
-  int8x8_t *iv = (int8x8_t *)input;
-  int32x4_t sum = {biases[0]};
-  int8x8_t *row = (int8x8_t *)weights;
-  int16x8_t p0 = vmull_s8(iv[0], row[0]);
-  int16x8_t p1 = vmull_s8(iv[1], row[1]);
-  p0 = vmlal_s8(p0, iv[2], row[2]);
-  sum = vpadalq_s16(sum, p0);
-  p1 = vmlal_s8(p1, iv[3], row[3]);
-  sum = vpadalq_s16(sum, p1);
-  return sum[0] + sum[1] + sum[2] + sum[3];
+// Input feature converter. Also the first section of the mapped format
+typedef struct {
+  int16_t biases alignas(64) [kHalfDimensions];
+  int16_t weights alignas(64) [kHalfDimensions * FtInDims];
+} Transformer;
+
+static_assert(sizeof(Transformer) == (1 + FtInDims) * kHalfDimensions * sizeof(int16_t), "Transformer has padding");
+
+// Weights of one net: An image of the mapped format ( Header, transformer, layers ).
+// A private copy of an original format file or the mapped file itself
+struct Network {
+  const char *image;
+  const Transformer *transformer;
+  const void *layers;            // Layers of the kernels in use
+  void *storage;                 // Private copy ( Owned ) or NULL
+  map_t map;                     // Mapped file ( Owned ) or 0
+  unsigned generation;           // Unique per load. Tags the Finny tables
+};
 
-#else
-  int32_t sum = biases[0];
-  for (unsigned j = 0; j < 32; ++j)
-    sum += weights[j] * input[j];
-  return sum;
+// Finny tables: Last accumulator of every perspective and king square with its pieces.
+// A refresh is a diff against it instead of a sum of all columns
+typedef struct {
+  alignas(64) int16_t accumulation[kHalfDimensions];
+  int8_t pieces[64];     // Piece on every square ( 0 = Empty. Kings excluded )
+  unsigned generation;   // Net it belongs to ( 0 = None )
+} FinnyEntry;
 
-#endif
-}
+static unsigned net_generation = 0;
+static thread_local FinnyEntry finny_table[2][64];
 
-static_assert(FtOutDims % 64 == 0, "FtOutDims not a multiple of 64");
+} // extern "C"
 
-#ifdef VECTOR
-INLINE bool next_idx(unsigned *idx, unsigned *offset, mask2_t *v,
-    mask_t *mask, unsigned inDims)
-{
-  while (*v == 0) {
-    *offset += 8 * sizeof(mask2_t);
-    if (*offset >= inDims) return false;
-    memcpy(v, (char *)mask + (*offset / 8), sizeof(mask2_t));
-  }
-#ifdef IS_64BIT
-  *idx = *offset + __builtin_ctzll(*v);
+/*kernels of one instruction set ( nnuekernels.hpp )*/
+typedef struct {
+  const char *name;
+  size_t layers_size;
+  void (*read_layers)(void *layers, const char *d);
+  void (*refresh_accumulator)(const Network *net, Accumulator *accumulator, int *pieces, int *squares);
+  void (*update_accumulator)(const Network *net, Accumulator *accumulator, const Accumulator *parent,
+      const DirtyPieces *dirty, int *pieces, int *squares);
+  int (*evaluate_accumulator)(const Network *net, int player, Accumulator *accumulator);
+} Kernels;
+
+#if defined(NNUE_DISPATCH)
+
+// x86-64: One set of kernels per instruction set, the best one the CPU
+// supports is picked at startup. The rest of the build targets x86-64-v2
+
+#define NNUE_PRAGMA(x) _Pragma(#x)
+#if defined(__clang__)
+#define NNUE_TARGET_PUSH(t) NNUE_PRAGMA(clang attribute push(__attribute__((target(t))), apply_to = function))
+#define NNUE_TARGET_POP NNUE_PRAGMA(clang attribute pop)
 #else
-  *idx = *offset + __builtin_ctzl(*v);
+#define NNUE_TARGET_PUSH(t) NNUE_PRAGMA(GCC push_options) NNUE_PRAGMA(GCC target(t))
+#define NNUE_TARGET_POP NNUE_PRAGMA(GCC pop_options)
 #endif
-  *v &= *v - 1;
-  return true;
-}
 
-#if defined(USE_MMX) && !defined(USE_SSE)
-INLINE int _mm_movemask_pi8(__m64 v)
-{
-  const __m64 powers = _mm_set_pi8(-128, 64, 32, 16, 8, 4, 2, 1);
-  __m64 m = _mm_and_si64(v, powers);
-  m = _mm_or_si64(m, _mm_srli_si64(m, 32));
-  m = _mm_or_si64(m, _mm_srli_pi32(m, 16));
-  m = _mm_or_si64(m, _mm_srli_pi16(m, 8));
-  return _mm_cvtsi64_si32(m) & 0xff;
+#define USE_SSE2 1
+#define USE_SSSE3 1
+#define USE_SSE41 1
+namespace sse41 {
+#include "nnuekernels.hpp"
 }
-#elif defined(USE_NEON)
-INLINE int neon_movemask(uint8x16_t v)
-{
-  const uint8_t __attribute__((aligned(16))) powers[16] =
-    { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
-  const uint8x16_t kPowers = vld1q_u8(powers);
 
-  uint64x2_t mask = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vandq_u8(v, kPowers))));
-  return   vgetq_lane_u8((uint8x16_t)mask, 0)
-        | (vgetq_lane_u8((uint8x16_t)mask, 8) << 8);
+#define USE_AVX2 1
+NNUE_TARGET_PUSH("avx2")
+namespace avx2 {
+#include "nnuekernels.hpp"
 }
-#endif
-#endif
+NNUE_TARGET_POP
 
-#if defined(USE_AVX512)
-INLINE void affine_txfm(int8_t *input, void *output, unsigned inDims,
-    unsigned outDims, int32_t *biases, weight_t *weights,
-    mask_t *inMask, mask_t *outMask, const bool pack8_and_calc_mask)
-{
-  assert(outDims == 32);
-
-  (void)outDims;
-  const __m512i kZero = _mm512_setzero_si512();
-  __m512i out_0 = ((__m512i *)biases)[0];
-  __m512i out_1 = ((__m512i *)biases)[1];
-  __m512i first, second;
-  mask2_t v;
-  unsigned idx;
-
-  memcpy(&v, inMask, sizeof(mask2_t));
-  for (unsigned offset = 0; offset < inDims;) {
-    if (!next_idx(&idx, &offset, &v, inMask, inDims))
-      break;
-    first = ((__m512i *)weights)[idx];
-    uint16_t factor = input[idx];
-    if (next_idx(&idx, &offset, &v, inMask, inDims)) {
-      second = ((__m512i *)weights)[idx];
-      factor |= input[idx] << 8;
-    } else {
-      second = kZero;
-    }
-    __m512i mul = _mm512_set1_epi16(factor), prod, signs;
-    prod = _mm512_maddubs_epi16(mul, _mm512_unpacklo_epi8(first, second));
-    signs = _mm512_srai_epi16(prod, 15);
-    out_0 = _mm512_add_epi32(out_0, _mm512_unpacklo_epi16(prod, signs));
-    out_1 = _mm512_add_epi32(out_1, _mm512_unpackhi_epi16(prod, signs));
-  }
-
-  __m512i out16 = _mm512_srai_epi16(_mm512_packs_epi32(out_0, out_1), SHIFT);
-
-  __m256i *outVec = (__m256i *)output;
-  const __m256i kZero256 = _mm256_setzero_si256();
-  outVec[0] = _mm256_packs_epi16(
-      _mm512_castsi512_si256(out16), _mm512_extracti64x4_epi64(out16, 1));
-  if (pack8_and_calc_mask)
-    outMask[0] = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(outVec[0], kZero256));
-  else
-    outVec[0] = _mm256_max_epi8(outVec[0], kZero256);
+#define USE_VNNI 1
+#define USE_AVXVNNI 1
+NNUE_TARGET_PUSH("avx2,avxvnni")
+namespace avx_vnni {
+#include "nnuekernels.hpp"
 }
-#elif defined(USE_AVX2)
-INLINE void affine_txfm(int8_t *input, void *output, unsigned inDims,
-    unsigned outDims, int32_t *biases, weight_t *weights,
-    mask_t *inMask, mask_t *outMask, const bool pack8_and_calc_mask)
-{
-  assert(outDims == 32);
-
-  (void)outDims;
-  const __m256i kZero = _mm256_setzero_si256();
-  __m256i out_0 = ((__m256i *)biases)[0];
-  __m256i out_1 = ((__m256i *)biases)[1];
-  __m256i out_2 = ((__m256i *)biases)[2];
-  __m256i out_3 = ((__m256i *)biases)[3];
-  __m256i first, second;
-  mask2_t v;
-  unsigned idx;
-
-  memcpy(&v, inMask, sizeof(mask2_t));
-  for (unsigned offset = 0; offset < inDims;) {
-    if (!next_idx(&idx, &offset, &v, inMask, inDims))
-      break;
-    first = ((__m256i *)weights)[idx];
-    uint16_t factor = input[idx];
-    if (next_idx(&idx, &offset, &v, inMask, inDims)) {
-      second = ((__m256i *)weights)[idx];
-      factor |= input[idx] << 8;
-    } else {
-      second = kZero;
-    }
-    __m256i mul = _mm256_set1_epi16(factor), prod, signs;
-    prod = _mm256_maddubs_epi16(mul, _mm256_unpacklo_epi8(first, second));
-    signs = _mm256_cmpgt_epi16(kZero, prod);
-    out_0 = _mm256_add_epi32(out_0, _mm256_unpacklo_epi16(prod, signs));
-    out_1 = _mm256_add_epi32(out_1, _mm256_unpackhi_epi16(prod, signs));
-    prod = _mm256_maddubs_epi16(mul, _mm256_unpackhi_epi8(first, second));
-    signs = _mm256_cmpgt_epi16(kZero, prod);
-    out_2 = _mm256_add_epi32(out_2, _mm256_unpacklo_epi16(prod, signs));
-    out_3 = _mm256_add_epi32(out_3, _mm256_unpackhi_epi16(prod, signs));
-  }
+NNUE_TARGET_POP
+#undef USE_AVXVNNI
+#undef USE_VNNI
 
-  __m256i out16_0 = _mm256_srai_epi16(_mm256_packs_epi32(out_0, out_1), SHIFT);
-  __m256i out16_1 = _mm256_srai_epi16(_mm256_packs_epi32(out_2, out_3), SHIFT);
-
-  __m256i *outVec = (__m256i *)output;
-  outVec[0] = _mm256_packs_epi16(out16_0, out16_1);
-  if (pack8_and_calc_mask)
-    outMask[0] = _mm256_movemask_epi8(_mm256_cmpgt_epi8(outVec[0], kZero));
-  else
-    outVec[0] = _mm256_max_epi8(outVec[0], kZero);
+#define USE_AVX512 1
+NNUE_TARGET_PUSH("avx2,avx512f,avx512bw")
+namespace avx512 {
+#include "nnuekernels.hpp"
 }
-#elif AVOID_USE_SSSE3
-INLINE void affine_txfm(int8_t *input, void *output, unsigned inDims,
-    unsigned outDims, int32_t *biases, weight_t *weights,
-    mask_t *inMask, mask_t *outMask, const bool pack8_and_calc_mask)
-{
-  assert(outDims == 32);
-
-  const __m128i kZeros[2] = { 0 };
-  __m128i out_0 = ((__m128i *)biases)[0];
-  __m128i out_1 = ((__m128i *)biases)[1];
-  __m128i out_2 = ((__m128i *)biases)[2];
-  __m128i out_3 = ((__m128i *)biases)[3];
-  __m128i out_4 = ((__m128i *)biases)[4];
-  __m128i out_5 = ((__m128i *)biases)[5];
-  __m128i out_6 = ((__m128i *)biases)[6];
-  __m128i out_7 = ((__m128i *)biases)[7];
-  const __m128i *second;
-  mask2_t v;
-  unsigned idx;
-
-  memcpy(&v, inMask, sizeof(mask2_t));
-  for (unsigned offset = 0; offset < inDims;) {
-    if (!next_idx(&idx, &offset, &v, inMask, inDims))
-      break;
-    const __m128i *first = (__m128i *)&weights[outDims * idx];
-    uint16_t factor = input[idx];
-    if (next_idx(&idx, &offset, &v, inMask, inDims)) {
-      second = (__m128i *)&weights[outDims * idx];
-      factor |= input[idx] << 8;
-    } else {
-      second = kZeros;
-    }
-    __m128i mul = _mm_set1_epi16(factor), prod, signs;
-    prod = _mm_maddubs_epi16(mul, _mm_unpacklo_epi8(first[0], second[0]));
-    signs = _mm_cmpgt_epi16(kZeros[0], prod);
-    out_0 = _mm_add_epi32(out_0, _mm_unpacklo_epi16(prod, signs));
-    out_1 = _mm_add_epi32(out_1, _mm_unpackhi_epi16(prod, signs));
-    prod = _mm_maddubs_epi16(mul, _mm_unpackhi_epi8(first[0], second[0]));
-    signs = _mm_cmpgt_epi16(kZeros[0], prod);
-    out_2 = _mm_add_epi32(out_2, _mm_unpacklo_epi16(prod, signs));
-    out_3 = _mm_add_epi32(out_3, _mm_unpackhi_epi16(prod, signs));
-    prod = _mm_maddubs_epi16(mul, _mm_unpacklo_epi8(first[1], second[1]));
-    signs = _mm_cmpgt_epi16(kZeros[0], prod);
-    out_4 = _mm_add_epi32(out_4, _mm_unpacklo_epi16(prod, signs));
-    out_5 = _mm_add_epi32(out_5, _mm_unpackhi_epi16(prod, signs));
-    prod = _mm_maddubs_epi16(mul, _mm_unpackhi_epi8(first[1], second[1]));
-    signs = _mm_cmpgt_epi16(kZeros[0], prod);
-    out_6 = _mm_add_epi32(out_6, _mm_unpacklo_epi16(prod, signs));
-    out_7 = _mm_add_epi32(out_7, _mm_unpackhi_epi16(prod, signs));
-  }
+NNUE_TARGET_POP
 
-  __m128i out16_0 = _mm_srai_epi16(_mm_packs_epi32(out_0, out_1), SHIFT);
-  __m128i out16_1 = _mm_srai_epi16(_mm_packs_epi32(out_2, out_3), SHIFT);
-  __m128i out16_2 = _mm_srai_epi16(_mm_packs_epi32(out_4, out_5), SHIFT);
-  __m128i out16_3 = _mm_srai_epi16(_mm_packs_epi32(out_6, out_7), SHIFT);
-
-  __m128i *outVec = (__m128i *)output;
-  if (pack8_and_calc_mask) {
-    outVec[0] = _mm_packs_epi16(out16_0, out16_1);
-    outMask[0] = _mm_movemask_epi8(_mm_cmpgt_epi8(outVec[0], kZeros[0]));
-    outVec[1] = _mm_packs_epi16(out16_2, out16_3);
-    outMask[1] = _mm_movemask_epi8(_mm_cmpgt_epi8(outVec[1], kZeros[0]));
-  } else {
-#if defined(USE_SSE41)
-    outVec[0] = _mm_max_epi8(_mm_packs_epi16(out16_0, out16_1), kZeros[0]);
-    outVec[1] = _mm_max_epi8(_mm_packs_epi16(out16_2, out16_3), kZeros[0]);
-#else
-    outVec[0] = _mm_packs_epi16(
-        _mm_max_epi16(out16_0, kZeros[0]), _mm_max_epi16(out16_1, kZeros[0]));
-    outVec[1] = _mm_packs_epi16(
-        _mm_max_epi16(out16_2, kZeros[0]), _mm_max_epi16(out16_3, kZeros[0]));
-#endif
-  }
+#define USE_VNNI 1
+NNUE_TARGET_PUSH("avx2,avx512f,avx512bw,avx512vl,avx512vnni")
+namespace avx512_vnni {
+#include "nnuekernels.hpp"
 }
-#elif defined(USE_SSE2)
-INLINE void affine_txfm(clipped_t *input, void *output, unsigned inDims,
-    unsigned outDims, int32_t *biases, weight_t *weights,
-    mask_t *inMask, mask_t *outMask, const bool pack8_and_calc_mask)
-{
-  assert(outDims == 32);
-
-  const __m128i kZeros[4] = { 0 };
-  __m128i out_0 = ((__m128i *)biases)[0];
-  __m128i out_1 = ((__m128i *)biases)[1];
-  __m128i out_2 = ((__m128i *)biases)[2];
-  __m128i out_3 = ((__m128i *)biases)[3];
-  __m128i out_4 = ((__m128i *)biases)[4];
-  __m128i out_5 = ((__m128i *)biases)[5];
-  __m128i out_6 = ((__m128i *)biases)[6];
-  __m128i out_7 = ((__m128i *)biases)[7];
-  const __m128i *second;
-  mask2_t v;
-  unsigned idx;
-
-  memcpy(&v, inMask, sizeof(mask2_t));
-  for (unsigned offset = 0; offset < inDims;) {
-    if (!next_idx(&idx, &offset, &v, inMask, inDims))
-      break;
-    const __m128i *first = (__m128i *)&weights[outDims * idx];
-    uint32_t factor = input[idx];
-    if (next_idx(&idx, &offset, &v, inMask, inDims)) {
-      second = (__m128i *)&weights[outDims * idx];
-      factor |= input[idx] << 16;
-    } else {
-      second = kZeros;
-    }
-    __m128i mul = _mm_set1_epi32(factor);
-    out_0 = _mm_add_epi32(out_0, _mm_madd_epi16(mul, _mm_unpacklo_epi16(first[0], second[0])));
-    out_1 = _mm_add_epi32(out_1, _mm_madd_epi16(mul, _mm_unpackhi_epi16(first[0], second[0])));
-    out_2 = _mm_add_epi32(out_2, _mm_madd_epi16(mul, _mm_unpacklo_epi16(first[1], second[1])));
-    out_3 = _mm_add_epi32(out_3, _mm_madd_epi16(mul, _mm_unpackhi_epi16(first[1], second[1])));
-    out_4 = _mm_add_epi32(out_4, _mm_madd_epi16(mul, _mm_unpacklo_epi16(first[2], second[2])));
-    out_5 = _mm_add_epi32(out_5, _mm_madd_epi16(mul, _mm_unpackhi_epi16(first[2], second[2])));
-    out_6 = _mm_add_epi32(out_6, _mm_madd_epi16(mul, _mm_unpacklo_epi16(first[3], second[3])));
-    out_7 = _mm_add_epi32(out_7, _mm_madd_epi16(mul, _mm_unpackhi_epi16(first[3], second[3])));
-  }
+NNUE_TARGET_POP
 
-  __m128i out16_0 = _mm_srai_epi16(_mm_packs_epi32(out_0, out_1), SHIFT);
-  __m128i out16_1 = _mm_srai_epi16(_mm_packs_epi32(out_2, out_3), SHIFT);
-  __m128i out16_2 = _mm_srai_epi16(_mm_packs_epi32(out_4, out_5), SHIFT);
-  __m128i out16_3 = _mm_srai_epi16(_mm_packs_epi32(out_6, out_7), SHIFT);
-
-  __m128i *outVec = (__m128i *)output;
-  if (pack8_and_calc_mask) {
-    outVec[0] = _mm_packs_epi16(out16_0, out16_1);
-    outMask[0] = _mm_movemask_epi8(_mm_cmpgt_epi8(outVec[0], kZeros[0]));
-    outVec[1] = _mm_packs_epi16(out16_2, out16_3);
-    outMask[1] = _mm_movemask_epi8(_mm_cmpgt_epi8(outVec[1], kZeros[0]));
-  } else {
-    const __m128i kx07f = _mm_set1_epi16(127);
-    outVec[0] = _mm_min_epi16(_mm_max_epi16(out16_0, kZeros[0]), kx07f);
-    outVec[1] = _mm_min_epi16(_mm_max_epi16(out16_1, kZeros[0]), kx07f);
-    outVec[2] = _mm_min_epi16(_mm_max_epi16(out16_2, kZeros[0]), kx07f);
-    outVec[3] = _mm_min_epi16(_mm_max_epi16(out16_3, kZeros[0]), kx07f);
-  }
-}
-#elif defined(USE_MMX)
-INLINE void affine_txfm(clipped_t *input, void *output, unsigned inDims,
-    unsigned outDims, int32_t *biases, weight_t *weights,
-    mask_t *inMask, mask_t *outMask, const bool pack8_and_calc_mask)
-{
-  assert(outDims == 32);
-
-  const __m64 kZeros[8] = { 0 };
-  __m64 out_0 = ((__m64 *)biases)[0];
-  __m64 out_1 = ((__m64 *)biases)[1];
-  __m64 out_2 = ((__m64 *)biases)[2];
-  __m64 out_3 = ((__m64 *)biases)[3];
-  __m64 out_4 = ((__m64 *)biases)[4];
-  __m64 out_5 = ((__m64 *)biases)[5];
-  __m64 out_6 = ((__m64 *)biases)[6];
-  __m64 out_7 = ((__m64 *)biases)[7];
-  __m64 out_8 = ((__m64 *)biases)[8];
-  __m64 out_9 = ((__m64 *)biases)[9];
-  __m64 out_10 = ((__m64 *)biases)[10];
-  __m64 out_11 = ((__m64 *)biases)[11];
-  __m64 out_12 = ((__m64 *)biases)[12];
-  __m64 out_13 = ((__m64 *)biases)[13];
-  __m64 out_14 = ((__m64 *)biases)[14];
-  __m64 out_15 = ((__m64 *)biases)[15];
-  const __m64 *first, *second;
-  mask2_t v;
-  unsigned idx;
-
-  memcpy(&v, inMask, sizeof(mask2_t));
-  for (unsigned offset = 0; offset < inDims;) {
-    if (!next_idx(&idx, &offset, &v, inMask, inDims))
-      break;
-    first = (__m64 *)&weights[outDims * idx];
-    uint32_t factor = input[idx];
-    if (next_idx(&idx, &offset, &v, inMask, inDims)) {
-      second = (__m64 *)&weights[outDims * idx];
-      factor |= input[idx] << 16;
-    } else {
-      second = kZeros;
-    }
-    __m64 mul = _mm_set1_pi32(factor);
-    out_0 = _mm_add_pi32(out_0, _mm_madd_pi16(mul, _mm_unpacklo_pi16(first[0], second[0])));
-    out_1 = _mm_add_pi32(out_1, _mm_madd_pi16(mul, _mm_unpackhi_pi16(first[0], second[0])));
-    out_2 = _mm_add_pi32(out_2, _mm_madd_pi16(mul, _mm_unpacklo_pi16(first[1], second[1])));
-    out_3 = _mm_add_pi32(out_3, _mm_madd_pi16(mul, _mm_unpackhi_pi16(first[1], second[1])));
-    out_4 = _mm_add_pi32(out_4, _mm_madd_pi16(mul, _mm_unpacklo_pi16(first[2], second[2])));
-    out_5 = _mm_add_pi32(out_5, _mm_madd_pi16(mul, _mm_unpackhi_pi16(first[2], second[2])));
-    out_6 = _mm_add_pi32(out_6, _mm_madd_pi16(mul, _mm_unpacklo_pi16(first[3], second[3])));
-    out_7 = _mm_add_pi32(out_7, _mm_madd_pi16(mul, _mm_unpackhi_pi16(first[3], second[3])));
-    out_8 = _mm_add_pi32(out_8, _mm_madd_pi16(mul, _mm_unpacklo_pi16(first[4], second[4])));
-    out_9 = _mm_add_pi32(out_9, _mm_madd_pi16(mul, _mm_unpackhi_pi16(first[4], second[4])));
-    out_10 = _mm_add_pi32(out_10, _mm_madd_pi16(mul, _mm_unpacklo_pi16(first[5], second[5])));
-    out_11 = _mm_add_pi32(out_11, _mm_madd_pi16(mul, _mm_unpackhi_pi16(first[5], second[5])));
-    out_12 = _mm_add_pi32(out_12, _mm_madd_pi16(mul, _mm_unpacklo_pi16(first[6], second[6])));
-    out_13 = _mm_add_pi32(out_13, _mm_madd_pi16(mul, _mm_unpackhi_pi16(first[6], second[6])));
-    out_14 = _mm_add_pi32(out_14, _mm_madd_pi16(mul, _mm_unpacklo_pi16(first[7], second[7])));
-    out_15 = _mm_add_pi32(out_15, _mm_madd_pi16(mul, _mm_unpackhi_pi16(first[7], second[7])));
-  }
+#undef USE_VNNI
+#undef USE_AVX512
+#undef USE_AVX2
+#undef USE_SSE41
+#undef USE_SSSE3
+#undef USE_SSE2
 
-  __m64 out16_0 = _mm_srai_pi16(_mm_packs_pi32(out_0, out_1), SHIFT);
-  __m64 out16_1 = _mm_srai_pi16(_mm_packs_pi32(out_2, out_3), SHIFT);
-  __m64 out16_2 = _mm_srai_pi16(_mm_packs_pi32(out_4, out_5), SHIFT);
-  __m64 out16_3 = _mm_srai_pi16(_mm_packs_pi32(out_6, out_7), SHIFT);
-  __m64 out16_4 = _mm_srai_pi16(_mm_packs_pi32(out_8, out_9), SHIFT);
-  __m64 out16_5 = _mm_srai_pi16(_mm_packs_pi32(out_10, out_11), SHIFT);
-  __m64 out16_6 = _mm_srai_pi16(_mm_packs_pi32(out_12, out_13), SHIFT);
-  __m64 out16_7 = _mm_srai_pi16(_mm_packs_pi32(out_14, out_15), SHIFT);
-
-  __m64 *outVec = (__m64 *)output;
-  if (pack8_and_calc_mask) {
-    outVec[0] = _mm_packs_pi16(out16_0, out16_1);
-    outMask[0] = _mm_movemask_pi8(_mm_cmpgt_pi8(outVec[0], kZeros[0]));
-    outVec[1] = _mm_packs_pi16(out16_2, out16_3);
-    outMask[1] = _mm_movemask_pi8(_mm_cmpgt_pi8(outVec[1], kZeros[0]));
-    outVec[2] = _mm_packs_pi16(out16_4, out16_5);
-    outMask[2] = _mm_movemask_pi8(_mm_cmpgt_pi8(outVec[2], kZeros[0]));
-    outVec[3] = _mm_packs_pi16(out16_6, out16_7);
-    outMask[3] = _mm_movemask_pi8(_mm_cmpgt_pi8(outVec[3], kZeros[0]));
-  } else {
-#ifdef USE_SSE
-    const __m64 kx07f = _mm_set1_pi16(127);
-    outVec[0] = _mm_min_pi16(_mm_max_pi16(out16_0, kZeros[0]), kx07f);
-    outVec[1] = _mm_min_pi16(_mm_max_pi16(out16_1, kZeros[0]), kx07f);
-    outVec[2] = _mm_min_pi16(_mm_max_pi16(out16_2, kZeros[0]), kx07f);
-    outVec[3] = _mm_min_pi16(_mm_max_pi16(out16_3, kZeros[0]), kx07f);
-    outVec[4] = _mm_min_pi16(_mm_max_pi16(out16_4, kZeros[0]), kx07f);
-    outVec[5] = _mm_min_pi16(_mm_max_pi16(out16_5, kZeros[0]), kx07f);
-    outVec[6] = _mm_min_pi16(_mm_max_pi16(out16_6, kZeros[0]), kx07f);
-    outVec[7] = _mm_min_pi16(_mm_max_pi16(out16_7, kZeros[0]), kx07f);
 #else
-    const __m64 k0x7f80 = _mm_set1_pi16(0x7f80);
-    const __m64 k0x0080 = _mm_set1_pi16(0x0080);
-    const __m64 k0x8000 = _mm_set1_pi16(-0x8000);
-    outVec[0] = _mm_subs_pu16(_mm_add_pi16(_mm_adds_pi16(out16_0, k0x7f80), k0x0080), k0x8000);
-    outVec[1] = _mm_subs_pu16(_mm_add_pi16(_mm_adds_pi16(out16_1, k0x7f80), k0x0080), k0x8000);
-    outVec[2] = _mm_subs_pu16(_mm_add_pi16(_mm_adds_pi16(out16_2, k0x7f80), k0x0080), k0x8000);
-    outVec[3] = _mm_subs_pu16(_mm_add_pi16(_mm_adds_pi16(out16_3, k0x7f80), k0x0080), k0x8000);
-    outVec[4] = _mm_subs_pu16(_mm_add_pi16(_mm_adds_pi16(out16_4, k0x7f80), k0x0080), k0x8000);
-    outVec[5] = _mm_subs_pu16(_mm_add_pi16(_mm_adds_pi16(out16_5, k0x7f80), k0x0080), k0x8000);
-    outVec[6] = _mm_subs_pu16(_mm_add_pi16(_mm_adds_pi16(out16_6, k0x7f80), k0x0080), k0x8000);
-    outVec[7] = _mm_subs_pu16(_mm_add_pi16(_mm_adds_pi16(out16_7, k0x7f80), k0x0080), k0x8000);
-#endif
-  }
-}
-
-#elif defined(USE_NEON)
-INLINE void affine_txfm(clipped_t *input, void *output, unsigned inDims,
-    unsigned outDims, int32_t *biases, weight_t *weights,
-    mask_t *inMask, mask_t *outMask, const bool pack8_and_calc_mask)
-{
-  assert(outDims == 32);
-
-  int32x4_t out_0 = ((int32x4_t *)biases)[0];
-  int32x4_t out_1 = ((int32x4_t *)biases)[1];
-  int32x4_t out_2 = ((int32x4_t *)biases)[2];
-  int32x4_t out_3 = ((int32x4_t *)biases)[3];
-  int32x4_t out_4 = ((int32x4_t *)biases)[4];
-  int32x4_t out_5 = ((int32x4_t *)biases)[5];
-  int32x4_t out_6 = ((int32x4_t *)biases)[6];
-  int32x4_t out_7 = ((int32x4_t *)biases)[7];
-  mask2_t v;
-  unsigned idx;
-
-  memcpy(&v, inMask, sizeof(mask2_t));
-  for (unsigned offset = 0; offset < inDims;) {
-    if (!next_idx(&idx, &offset, &v, inMask, inDims))
-      break;
-    const int8x8_t *first = (int8x8_t *)&weights[outDims * idx];
-    int16_t factor = input[idx];
-
-    int16x8_t prod;
-    prod = vmulq_n_s16(vmovl_s8(first[0]), factor);
-    out_0 = vaddq_s32(out_0, vmovl_s16(vget_low_s16(prod)));
-    out_1 = vaddq_s32(out_1, vmovl_high_s16(prod));
-    prod = vmulq_n_s16(vmovl_s8(first[1]), factor);
-    out_2 = vaddq_s32(out_2, vmovl_s16(vget_low_s16(prod)));
-    out_3 = vaddq_s32(out_3, vmovl_high_s16(prod));
-    prod = vmulq_n_s16(vmovl_s8(first[2]), factor);
-    out_4 = vaddq_s32(out_4, vmovl_s16(vget_low_s16(prod)));
-    out_5 = vaddq_s32(out_5, vmovl_high_s16(prod));
-    prod = vmulq_n_s16(vmovl_s8(first[3]), factor);
-    out_6 = vaddq_s32(out_6, vmovl_s16(vget_low_s16(prod)));
-    out_7 = vaddq_s32(out_7, vmovl_high_s16(prod));
-  }
 
-  int16x8_t out16_0 = vcombine_s16(vqshrn_n_s32(out_0, SHIFT), vqshrn_n_s32(out_1, SHIFT));
-  int16x8_t out16_1 = vcombine_s16(vqshrn_n_s32(out_2, SHIFT), vqshrn_n_s32(out_3, SHIFT));
-  int16x8_t out16_2 = vcombine_s16(vqshrn_n_s32(out_4, SHIFT), vqshrn_n_s32(out_5, SHIFT));
-  int16x8_t out16_3 = vcombine_s16(vqshrn_n_s32(out_6, SHIFT), vqshrn_n_s32(out_7, SHIFT));
-
-  if (pack8_and_calc_mask) {
-    const int8x16_t kZero = { 0 };
-    int8x16_t *outVec = (int8x16_t *)output;
-    outVec[0] = vcombine_s8(vqmovn_s16(out16_0), vqmovn_s16(out16_1));
-    outMask[0] = neon_movemask(vcgtq_s8(outVec[0], kZero));
-    outVec[1] = vcombine_s8(vqmovn_s16(out16_2), vqmovn_s16(out16_3));
-    outMask[1] = neon_movemask(vcgtq_s8(outVec[1], kZero));
-  } else {
-    // The next step takes int8x8_t as input, so store as int8x8_t
-    const int8x8_t kZero = { 0 };
-    int8x8_t *outVec = (int8x8_t *)output;
-    outVec[0] = vmax_s8(vqmovn_s16(out16_0), kZero);
-    outVec[1] = vmax_s8(vqmovn_s16(out16_1), kZero);
-    outVec[2] = vmax_s8(vqmovn_s16(out16_2), kZero);
-    outVec[3] = vmax_s8(vqmovn_s16(out16_3), kZero);
-  }
+// The instruction set of the build ( USE_* flags )
+namespace native {
+#include "nnuekernels.hpp"
 }
-#else /* generic fallback */
-INLINE void affine_txfm(clipped_t *input, void *output, unsigned inDims,
-    unsigned outDims, int32_t *biases, weight_t *weights,
-    mask_t *inMask, mask_t *outMask, const bool pack8_and_calc_mask)
-{
-  (void)inMask; (void)outMask; (void)pack8_and_calc_mask;
-
-  assert(outDims == 32);
-  int32_t tmp[32]; // No VLA / if out vector != 32 crash
-
-  for (unsigned i = 0; i < outDims; ++i)
-    tmp[i] = biases[i];
 
-  for (unsigned idx = 0; idx < inDims; ++idx)
-    if (input[idx])
-      for (unsigned i = 0; i < outDims; ++i)
-        tmp[i] += (int8_t)input[idx] * weights[outDims * idx + i];
-
-  clipped_t *outVec = (clipped_t *)output;
-  for (unsigned i = 0, t; i < outDims; ++i)
-    t = tmp[i] >> SHIFT, outVec[i] = min_u32(t, 127);
-}
 #endif
 
-// Input feature converter
-static int16_t ft_biases alignas(64) [kHalfDimensions];
-static int16_t ft_weights alignas(64) [kHalfDimensions * FtInDims];
-
-#ifdef VECTOR
-#define TILE_HEIGHT (NUM_REGS * SIMD_WIDTH / 16)
-#endif
+extern "C" {
 
-// Calculate cumulative value without using difference calculation
-INLINE void refresh_accumulator(Position *pos)
-{
-  Accumulator *accumulator = &(pos->accumulator);
-
-  IndexList activeIndices[2];
-  activeIndices[0].size = activeIndices[1].size = 0;
-  append_active_indices(pos, activeIndices);
-
-  for (unsigned c = 0; c < 2; ++c) {
-#ifdef VECTOR
-    for (unsigned i = 0; i < kHalfDimensions / TILE_HEIGHT; ++i) {
-      vec16_t *ft_biases_tile = (vec16_t *)&ft_biases[i * TILE_HEIGHT];
-      vec16_t *accTile = (vec16_t *)&accumulator->accumulation[c][i * TILE_HEIGHT];
-      vec16_t acc[NUM_REGS];
-
-      for (unsigned j = 0; j < NUM_REGS; ++j)
-        acc[j] = ft_biases_tile[j];
-
-      for (size_t k = 0; k < activeIndices[c].size; ++k) {
-        unsigned index = activeIndices[c].values[k];
-        unsigned offset = kHalfDimensions * index + i * TILE_HEIGHT;
-        vec16_t *column = (vec16_t *)&ft_weights[offset];
-
-        for (unsigned j = 0; j < NUM_REGS; ++j)
-          acc[j] = vec_add_16(acc[j], column[j]);
-      }
-
-      for (unsigned j = 0; j < NUM_REGS; ++j)
-        accTile[j] = acc[j];
-    }
+// CPUID. AVX-VNNI is CPUID.(EAX=7,ECX=1):EAX[4]
+static const Kernels *select_kernels(void)
+{
+#if defined(NNUE_DISPATCH)
+  unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+  __get_cpuid_count(7, 1, &eax, &ebx, &ecx, &edx);
+  __builtin_cpu_init();
+  const bool avx2 = __builtin_cpu_supports("avx2");
+  const bool avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+
+  if (avx512 && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512vnni"))
+    return &avx512_vnni::kernels;
+  if (avx2 && (eax & (1U << 4)))
+    return &avx_vnni::kernels;
+  if (avx512)
+    return &avx512::kernels;
+  if (avx2)
+    return &avx2::kernels;
+  return &sse41::kernels;
 #else
-    memcpy(accumulator->accumulation[c], ft_biases,
-        kHalfDimensions * sizeof(int16_t));
-
-    for (size_t k = 0; k < activeIndices[c].size; ++k) {
-      unsigned index = activeIndices[c].values[k];
-      unsigned offset = kHalfDimensions * index;
-
-      for (unsigned j = 0; j < kHalfDimensions; ++j)
-        accumulator->accumulation[c][j] += ft_weights[offset + j];
-    }
+  return &native::kernels;
 #endif
-  }
-
-  accumulator->computedAccumulation = true;
 }
 
-// Convert input features
-INLINE void transform(Position *pos, clipped_t *output, mask_t *outMask)
-{
-  (void) outMask; // avoid compiler warning
-  refresh_accumulator(pos);
-  int16_t (*accumulation)[2][256] = &pos->accumulator.accumulation;
-
-  const int perspectives[2] = { pos->player, !pos->player };
-  for (unsigned p = 0; p < 2; ++p) {
-    const unsigned offset = kHalfDimensions * p;
-
-#ifdef VECTOR
-  const unsigned numChunks = (16 * kHalfDimensions) / SIMD_WIDTH;
-  vec8_t *out = (vec8_t *)&output[offset];
-  for (unsigned i = 0; i < numChunks / 2; ++i) {
-    vec16_t s0 = ((vec16_t *)(*accumulation)[perspectives[p]])[i * 2];
-    vec16_t s1 = ((vec16_t *)(*accumulation)[perspectives[p]])[i * 2 + 1];
-    out[i] = vec_packs(s0, s1);
-    *outMask++ = vec_mask_pos(out[i]);
-  }
+static const Kernels *kernels_in_use = select_kernels();
 
-#else
-  for (unsigned i = 0; i < kHalfDimensions; ++i)
-    output[offset + i] = clamp_i16((*accumulation)[perspectives[p]][i], 0, 127);
-#endif
-
-  }
+// Evaluation function
+int nnue_evaluate_pos(const Network *net, Position *pos)
+{
+  kernels_in_use->refresh_accumulator(net, &pos->accumulator, pos->pieces, pos->squares);
+  return kernels_in_use->evaluate_accumulator(net, pos->player, &pos->accumulator);
 }
 
-struct NetData {
-  alignas(64) clipped_t input[FtOutDims];
-  clipped_t hidden1_out[32];
-#if (defined(USE_SSE2) || defined(USE_MMX)) && !defined(USE_AVX2)
-  int16_t hidden2_out[32];
-#else
-  int8_t hidden2_out[32];
-#endif
+// Original format: Version, hash, description of any length, then the
+// transformer and network sections of HalfKP 256x2-32-32
+enum {
+  TransformerSize = 2 * 256 + 2 * 256 * 64 * 641,
+  NetworkSize = 4 * 32 + 32 * 512 + 4 * 32 + 32 * 32 + 4 + 32
 };
 
-// Evaluation function
-int nnue_evaluate_pos(Position *pos)
+static size_t transformer_start(const char *d)
 {
-  int32_t out_value;
-  alignas(8) mask_t input_mask[FtOutDims / (8 * sizeof(mask_t))];
-  alignas(8) mask_t hidden1_mask[8 / sizeof(mask_t)] = { 0 };
-#ifdef ALIGNMENT_HACK // work around a bug in old gcc on Windows
-  uint8_t buf[sizeof(struct NetData) + 63];
-  struct NetData *b = (struct NetData *)(buf + ((((uintptr_t)buf-1) ^ 0x3f) & 0x3f));
-#define B(x) (b->x)
-#else
-  struct NetData buf;
-#define B(x) (buf.x)
-#endif
-
-  transform(pos, B(input), input_mask);
-
-  affine_txfm(B(input), B(hidden1_out), FtOutDims, 32,
-      hidden1_biases, hidden1_weights, input_mask, hidden1_mask, true);
-
-  affine_txfm(B(hidden1_out), B(hidden2_out), 32, 32,
-      hidden2_biases, hidden2_weights, hidden1_mask, NULL, false);
-
-  out_value = affine_propagate((int8_t *)B(hidden2_out), output_biases,
-      output_weights);
-
-#if defined(USE_MMX)
-  _mm_empty();
-#endif
-
-  return out_value / FV_SCALE;
+  return 3 * 4 + (size_t)readu_le_u32(d + 8);
 }
 
-static void read_output_weights(weight_t *w, const char *d)
+static bool verify_net(const void *evalData, size_t size)
 {
-  for (unsigned i = 0; i < 32; ++i) {
-    unsigned c = i;
-#if defined(USE_AVX512)
-    unsigned b = c & 0x18;
-    b = (b << 1) | (b >> 1);
-    c = (c & ~0x18) | (b & 0x18);
-#endif
-    w[c] = *d++;
-  }
-}
+  if (size < 3 * 4) return false;
 
-INLINE unsigned wt_idx(unsigned r, unsigned c, unsigned dims)
-{
-  (void)dims;
+  const char *d = (const char*)evalData;
+  const size_t ft_start = transformer_start(d);
+  const size_t net_start = ft_start + 4 + TransformerSize;
+  if (size != net_start + 4 + NetworkSize) return false;
+  if (readu_le_u32(d) != NnueVersion) return false;
+  if (readu_le_u32(d + 4) != 0x3e5aa6eeU) return false;
+  if (readu_le_u32(d + ft_start) != 0x5d69d7b8) return false;
+  if (readu_le_u32(d + net_start) != 0x63337156) return false;
 
-#if defined(USE_AVX512)
-  if (dims > 32) {
-    unsigned b = c & 0x38;
-    b = (b << 1) | (b >> 2);
-    c = (c & ~0x38) | (b & 0x38);
-  }
-  else if (dims == 32) {
-    unsigned b = c & 0x18;
-    b = (b << 1) | (b >> 1);
-    c = (c & ~0x18) | (b & 0x18);
-  }
+  return true;
+}
 
-#elif defined(USE_AVX2)
-  if (dims > 32) {
-    unsigned b = c & 0x18;
-    b = (b << 1) | (b >> 1);
-    c = (c & ~0x18) | (b & 0x18);
-  }
+// Mapped format: Header, then the transformer and network sections exactly as
+// the kernels in use lay them out in memory. Used in place from a shared
+// read-only mapping, so processes on one host share a single copy
 
-#endif
+static const char MappedMagic[8] = { 'M', 'A', 'Y', 'H', 'E', 'M', 'N', 'N' };
 
-#if defined(USE_AVX512)
-  return c * 64 + r + (r & ~7);
+enum {
+  MappedVersion = 1,
+  MappedStart = 64 // Transformer offset. Sections stay 64-byte aligned
+};
 
-#else
-  return c * 32 + r;
+typedef struct {
+  char magic[8];               /** MappedMagic */
+  uint32_t version;            /** MappedVersion */
+  uint32_t nnue_version;       /** NnueVersion of the original file */
+  char layout[16];             /** Kernels the network section is permuted for ( e.g. "avx2" ) */
+  uint64_t transformer_size;   /** sizeof(Transformer) */
+  uint64_t layers_size;        /** sizeof(Layers) of those kernels */
+} MappedHeader;
+
+static_assert(sizeof(MappedHeader) <= MappedStart, "MappedHeader too big");
+static_assert(sizeof(((MappedHeader *)0)->layout) + 1 == NNUE_LAYOUT_SIZE, "NNUE_LAYOUT_SIZE");
+static_assert(sizeof(Transformer) % 64 == 0, "Transformer breaks the alignment");
+
+// Unit of a private copy. Keeps it 64-byte aligned
+typedef struct {
+  alignas(64) char bytes[64];
+} CacheLine;
 
-#endif
+static size_t image_size(void)
+{
+  return MappedStart + sizeof(Transformer) + kernels_in_use->layers_size;
 }
 
-static const char *read_hidden_weights(weight_t *w, unsigned dims, const char *d)
+static Network *new_net(const char *image, void *storage, map_t map)
 {
-  for (unsigned r = 0; r < 32; ++r)
-    for (unsigned c = 0; c < dims; ++c)
-      w[wt_idx(r, c, dims)] = *d++;
-
-  return d;
+  Network *net = new Network();
+  net->image = image;
+  net->transformer = (const Transformer *)(image + MappedStart);
+  net->layers = image + MappedStart + sizeof(Transformer);
+  net->storage = storage;
+  net->map = map;
+  net->generation = ++net_generation; // Finny tables of older nets are stale
+  return net;
 }
 
-#ifdef USE_AVX2
-static void permute_biases(int32_t *biases)
+static void free_net(Network *net)
 {
-  __m128i *b = (__m128i *)biases;
-  __m128i tmp[8];
-#ifdef USE_AVX512
-  tmp[0] = b[0];
-  tmp[1] = b[2];
-  tmp[2] = b[4];
-  tmp[3] = b[6];
-  tmp[4] = b[1];
-  tmp[5] = b[3];
-  tmp[6] = b[5];
-  tmp[7] = b[7];
-#elif USE_AVX2
-  tmp[0] = b[0];
-  tmp[1] = b[4];
-  tmp[2] = b[1];
-  tmp[3] = b[5];
-  tmp[4] = b[2];
-  tmp[5] = b[6];
-  tmp[6] = b[3];
-  tmp[7] = b[7];
-#else
-#error
-#endif
-  memcpy(b, tmp, 8 * sizeof(__m128i));
+  if (!net) return;
+  if (net->storage)
+    delete[] (CacheLine *)net->storage;
+  else if (net->map)
+    unmap_file(net->image, net->map);
+  delete net;
 }
-#endif
 
-enum {
-  TransformerStart = 3 * 4 + 177,
-  NetworkStart = TransformerStart + 4 + 2 * 256 + 2 * 256 * 64 * 641
-};
-
-static bool verify_net(const void *evalData, size_t size)
+static bool verify_mapped(const void *data, size_t size, char *layout)
 {
-  if (size != 21022697) return false;
+  const MappedHeader *header = (const MappedHeader *)data;
+  if (size < MappedStart) return false;
+  if (memcmp(header->magic, MappedMagic, sizeof(MappedMagic))) return false;
+  if (header->version != MappedVersion) return false;
 
-  const char *d = (const char*)evalData;
-  if (readu_le_u32(d) != NnueVersion) return false;
-  if (readu_le_u32(d + 4) != 0x3e5aa6eeU) return false;
-  if (readu_le_u32(d + 8) != 177) return false;
-  if (readu_le_u32(d + TransformerStart) != 0x5d69d7b8) return false;
-  if (readu_le_u32(d + NetworkStart) != 0x63337156) return false;
+  if (layout) {
+    memcpy(layout, header->layout, sizeof(header->layout));
+    layout[sizeof(header->layout)] = 0;
+  }
+  if (strncmp(header->layout, kernels_in_use->name, sizeof(header->layout))) return false;
 
-  return true;
+  return header->transformer_size == sizeof(Transformer)
+      && header->layers_size == kernels_in_use->layers_size
+      && size == image_size();
 }
 
-static void init_weights(const void *evalData)
+// Original format -> Private copy laid out like the mapped format
+static Network *read_net(const void *evalData)
 {
-  const char *d = (const char *)evalData + TransformerStart + 4;
+  const size_t size = image_size();
+  CacheLine *storage = new CacheLine[size / sizeof(CacheLine)]();
+  char *image = (char *)storage;
+
+  MappedHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MappedMagic, sizeof(MappedMagic));
+  header.version = MappedVersion;
+  header.nnue_version = NnueVersion;
+  memcpy(header.layout, kernels_in_use->name, min_u32(strlen(kernels_in_use->name), sizeof(header.layout) - 1));
+  header.transformer_size = sizeof(Transformer);
+  header.layers_size = kernels_in_use->layers_size;
+  memcpy(image, &header, sizeof(header));
 
   // Read transformer
+  Transformer *transformer = (Transformer *)(image + MappedStart);
+  const char *d = (const char *)evalData;
+  d += transformer_start(d) + 4;
   for (unsigned i = 0; i < kHalfDimensions; ++i, d += 2)
-    ft_biases[i] = readu_le_u16(d);
+    transformer->biases[i] = readu_le_u16(d);
   for (unsigned i = 0; i < kHalfDimensions * FtInDims; ++i, d += 2)
-    ft_weights[i] = readu_le_u16(d);
+    transformer->weights[i] = readu_le_u16(d);
 
   // Read network
-  d += 4;
-  for (unsigned i = 0; i < 32; ++i, d += 4)
-    hidden1_biases[i] = readu_le_u32(d);
-  d = read_hidden_weights(hidden1_weights, 512, d);
-  for (unsigned i = 0; i < 32; ++i, d += 4)
-    hidden2_biases[i] = readu_le_u32(d);
-  d = read_hidden_weights(hidden2_weights, 32, d);
-  for (unsigned i = 0; i < 1; ++i, d += 4)
-    output_biases[i] = readu_le_u32(d);
-  read_output_weights(output_weights, d);
-
-#ifdef USE_AVX2
-  permute_biases(hidden1_biases);
-  permute_biases(hidden2_biases);
-#endif
+  kernels_in_use->read_layers(image + MappedStart + sizeof(Transformer), d + 4);
+
+  return new_net(image, storage, 0);
 }
 
-static bool load_eval_file(const char *evalFile)
+static Network *load_eval_file(const char *evalFile, char *layout)
 {
   const void *evalData;
   map_t mapping;
   size_t size;
 
+  if (layout) layout[0] = 0;
+
 #ifdef NNUE_EMBEDDED
+  // The program provides DefaultEvalFile, gNetworkData and gNetworkSize.
+  // A mapped-format image is used in place. The default net is in the
+  // original format, so it is permuted into a private copy like a file
   if (strcmp(evalFile, DefaultEvalFile) == 0) {
     evalData = gNetworkData;
     mapping = 0;
@@ -1289,34 +714,87 @@ static bool load_eval_file(const char *evalFile)
 #endif
   {
     const FD fd = open_file(evalFile);
-    if (fd == FD_ERR) return false;
+    if (fd == FD_ERR) return NULL;
     evalData = map_file(fd, &mapping);
     size = file_size(fd);
     close_file(fd);
   }
 
-  const bool success = verify_net(evalData, size);
-  if (success)
-    init_weights(evalData);
+  if (evalData && verify_mapped(evalData, size, layout))
+    return new_net((const char *)evalData, NULL, mapping); // Used in place
+
+  Network *net = evalData && verify_net(evalData, size) ? read_net(evalData) : NULL;
+  if (mapping) unmap_file(evalData, mapping);
+  return net;
+}
+
+static bool convert_eval_file(const char *evalFile, const char *outFile)
+{
+  const FD fd = open_file(evalFile);
+  if (fd == FD_ERR) return false;
+  map_t mapping;
+  const void *evalData = map_file(fd, &mapping);
+  const size_t size = file_size(fd);
+  close_file(fd);
+
+  Network *net = evalData && verify_net(evalData, size) ? read_net(evalData) : NULL;
   if (mapping) unmap_file(evalData, mapping);
+  if (!net) return false;
+
+  // The private copy is the mapped file
+  FILE *f = fopen(outFile, "wb");
+  bool success = f && fwrite(net->image, image_size(), 1, f) == 1;
+  if (f && fclose(f)) success = false;
+  free_net(net);
   return success;
 }
 
 /*
 Interfaces
 */
-bool _CDECL nnue_init(const char* evalFile)
+Network * _CDECL nnue_load(const char* evalFile, char* layout)
 {
-  return load_eval_file(evalFile);
+  return load_eval_file(evalFile, layout);
 }
 
-int _CDECL nnue_evaluate(int player, int* pieces, int* squares)
+void _CDECL nnue_free(Network* net)
+{
+  free_net(net);
+}
+
+bool _CDECL nnue_convert(const char* evalFile, const char* outFile)
+{
+  return convert_eval_file(evalFile, outFile);
+}
+
+int _CDECL nnue_evaluate(const Network* net, int player, int* pieces, int* squares)
 {
   Position pos;
   pos.player = player;
   pos.pieces = pieces;
   pos.squares = squares;
-  return nnue_evaluate_pos(&pos);
+  return nnue_evaluate_pos(net, &pos);
+}
+
+void _CDECL nnue_refresh_accumulator(const Network* net, Accumulator* accumulator, int* pieces, int* squares)
+{
+  kernels_in_use->refresh_accumulator(net, accumulator, pieces, squares);
+}
+
+void _CDECL nnue_update_accumulator(const Network* net, Accumulator* accumulator, const Accumulator* parent,
+    const DirtyPieces* dirty, int* pieces, int* squares)
+{
+  kernels_in_use->update_accumulator(net, accumulator, parent, dirty, pieces, squares);
+}
+
+int _CDECL nnue_evaluate_accumulator(const Network* net, int player, Accumulator* accumulator)
+{
+  return kernels_in_use->evaluate_accumulator(net, player, accumulator);
+}
+
+const char * _CDECL nnue_kernels(void)
+{
+  return kernels_in_use->name;
 }
 
 // nnue.cpp end
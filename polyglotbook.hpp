@@ -51,6 +51,7 @@ class PolyglotBook : private std::ifstream {
     int probe(const bool);
     PolyglotBook& setup(std::int8_t*, const std::uint64_t, const std::uint8_t, const std::int8_t, const bool);
     bool open_book(const std::string&);
+    bool open_book(const std::uint8_t*, const std::size_t);
 
  private:
     template<typename T>
@@ -75,8 +76,14 @@ class PolyglotBook : private std::ifstream {
       std::uint8_t  wtm;
     } polyboard;
 
+    // Book in memory ( e.g. embedded in the executable ). Read in place
+    const std::uint8_t *memory = nullptr;
+    std::size_t memory_size    = 0;
+
     std::uint64_t polyglot_key() const;
     bool open(const std::string&);
+    std::size_t size();
+    bool read(const std::size_t, Entry&);
     std::size_t find_first(const std::uint64_t);
     bool is_ep_legal() const;
     inline int ctz(const std::uint64_t bb) const { return __builtin_ctzll(bb); }
@@ -435,6 +442,9 @@ bool PolyglotBook::open(const std::string &file) {
   if (this->is_open()) // Cannot close an already closed file
       this->close();
 
+  this->memory      = nullptr;
+  this->memory_size = 0;
+
   std::ifstream::open(file, std::ifstream::in | std::ifstream::binary);
   const auto opened = this->is_open();
   std::ifstream::clear(); // Reset any error flag to allow a retry ifstream::open()
@@ -451,6 +461,19 @@ bool PolyglotBook::open_book(const std::string &file) {
   return this->open(file);
 }
 
+/// open_book() with a book in memory. The bytes must outlive the book and
+/// are never copied.
+
+bool PolyglotBook::open_book(const std::uint8_t *data, const std::size_t bytes) {
+  if (this->is_open())
+      this->close();
+
+  this->memory      = data;
+  this->memory_size = data ? bytes - bytes % sizeof(Entry) : 0;
+
+  return this->memory_size > 0;
+}
+
 
 bool PolyglotBook::is_ep_legal() const {
   // -1 means no en passant possible
@@ -480,7 +503,7 @@ PolyglotBook& PolyglotBook::setup(std::int8_t *pieces, const std::uint64_t both,
 }
 
 int PolyglotBook::probe(const bool pick_best) {
-  if (!this->is_open())
+  if (!this->memory && !this->is_open())
     return 0;
 
   Entry e            = {};
@@ -488,10 +511,9 @@ int PolyglotBook::probe(const bool pick_best) {
   unsigned sum       = 0;
   int move           = 0;
   const auto key     = this->polyglot_key();
+  const auto n       = this->size();
 
-  this->seekg(this->find_first(key) * sizeof(Entry), std::ios_base::beg);
-
-  while (*this >> e, e.key == key && this->good()) {
+  for (auto i = n ? this->find_first(key) : n; i < n && this->read(i, e) && e.key == key; ++i) {
       best = std::max(best, e.count);
       sum += e.count;
 
@@ -517,22 +539,48 @@ int PolyglotBook::probe(const bool pick_best) {
   // out the special Move flags (bit 14-15) that are not supported by PolyGlot.
 }
 
+/// size() returns the number of entries in the book.
+
+std::size_t PolyglotBook::size() {
+  if (this->memory)
+    return this->memory_size / sizeof(Entry);
+
+  this->seekg(0, std::ios::end); // Move pointer to end, so tellg() gets file's size
+  return static_cast<std::size_t>(this->tellg()) / sizeof(Entry);
+}
+
+/// read() reads the nth entry. Straight from memory or from the file.
+
+bool PolyglotBook::read(const std::size_t nth, Entry &e) {
+  if (this->memory) {
+    const std::uint8_t *p = this->memory + nth * sizeof(Entry);
+    e = {};
+    for (std::size_t i = 0; i < 8; ++i) e.key   = (e.key << 8) | *p++;
+    for (std::size_t i = 0; i < 2; ++i) e.move  = std::uint16_t((e.move << 8) | *p++);
+    for (std::size_t i = 0; i < 2; ++i) e.count = std::uint16_t((e.count << 8) | *p++);
+    for (std::size_t i = 0; i < 4; ++i) e.learn = (e.learn << 8) | *p++;
+    return true;
+  }
+
+  this->seekg(nth * sizeof(Entry), std::ios_base::beg);
+  *this >> e;
+  return this->good();
+}
+
 /// find_first() takes a book key as input, and does a binary search through
 /// the book file for the given key. Returns the index of the leftmost book
 /// entry with the same key as the input.
 
 std::size_t PolyglotBook::find_first(const std::uint64_t key) {
-  this->seekg(0, std::ios::end); // Move pointer to end, so tellg() gets file's size
-
-  std::size_t low = 0, high = static_cast<std::size_t>(this->tellg()) / sizeof(Entry) - 1;
+  std::size_t low = 0, high = this->size() - 1;
   Entry e{};
 
-  while (low < high && this->good()) {
+  while (low < high) {
 
     const std::size_t mid = (low + high) / 2;
 
-    this->seekg(mid * sizeof(Entry), std::ios_base::beg);
-    *this >> e;
+    if (!this->read(mid, e))
+      break;
 
     if (key <= e.key)
       high = mid;